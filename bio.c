@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a set of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -12,84 +12,377 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * To start reading a block that will be wanted soon
+//     without waiting for it, call bprefetch.
+// * To have several transfers in flight at once, start each
+//     with bread_async or bwrite_async, then call bwait on
+//     each buffer before using its data or releasing it.
 //
-// The implementation uses two state flags internally:
+// Buffers are found through a hash table of (dev, blockno),
+// each bucket a list with its own lock, so lookups of different
+// blocks do not contend.  A buffer moves between buckets only
+// when it is recycled for another block; that takes evictlock
+// as well, so only one process at a time picks a victim.
+// Victims come from the tail of the LRU list, which holds the
+// unused, clean buffers in the order they were released.
+// brelse links a buffer in and a lookup that finds it takes
+// it out, under lrulock, which is taken after a bucket lock.
+//
+// Beyond the NBUF buffers that are always there, the cache
+// grows a page of buffers at a time whenever it misses, up to
+// BCACHEPCT percent of memory, and only then recycles the least
+// recently released unused buffer.  When kalloc runs out of
+// memory it calls bshrink to give a page of idle buffers back.
+//
+// The implementation uses three state flags internally:
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+// * B_FREE: the buffer holds no block, and is on the free list
+//     rather than in a bucket.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
 
-struct {
+#define NBUCKET 61
+#define BHASH(dev, blockno) (((dev)*7 + (blockno)) % NBUCKET)
+
+// A page of buffers the cache has grown into.
+#define BPERPAGE ((PGSIZE - sizeof(void*)) / sizeof(struct buf))
+struct bpage {
+  struct bpage *next;
+  struct buf buf[BPERPAGE];
+};
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;  // List of buffers, through prev/next
+};
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+// evictlock protects everything but the buckets and the LRU
+// list, and is held while recycling, growing or shrinking.
+struct {
+  struct spinlock evictlock;
+  struct spinlock lrulock;
+  struct buf *lruhead;         // Most recently released
+  struct buf *lrutail;         // Least recently released
+  struct buf buf[NBUF];
+  struct bpage *pages;         // Grown into, newest first
+  int npages;
+  int maxpages;
+  struct buf *free;            // B_FREE buffers, through next
+  struct bucket bucket[NBUCKET];
 } bcache;
 
+// Link b into bucket k.  k->lock must be held.
+static void
+bucketadd(struct bucket *k, struct buf *b)
+{
+  b->prev = 0;
+  b->next = k->head;
+  if(k->head)
+    k->head->prev = b;
+  k->head = b;
+}
+
+// Unlink b from bucket k.  k->lock must be held.
+static void
+bucketdel(struct bucket *k, struct buf *b)
+{
+  if(b->prev)
+    b->prev->next = b->next;
+  else
+    k->head = b->next;
+  if(b->next)
+    b->next->prev = b->prev;
+}
+
+// Unlink b from the LRU list, if it is on it.
+// lrulock must be held.
+static void
+lrudel(struct buf *b)
+{
+  if(!b->onlru)
+    return;
+  if(b->lruprev)
+    b->lruprev->lrunext = b->lrunext;
+  else
+    bcache.lruhead = b->lrunext;
+  if(b->lrunext)
+    b->lrunext->lruprev = b->lruprev;
+  else
+    bcache.lrutail = b->lruprev;
+  b->onlru = 0;
+}
+
+// Make b the most recently released buffer on the LRU list.
+// lrulock must be held.
+static void
+lruadd(struct buf *b)
+{
+  lrudel(b);
+  b->lruprev = 0;
+  b->lrunext = bcache.lruhead;
+  if(bcache.lruhead)
+    bcache.lruhead->lruprev = b;
+  else
+    bcache.lrutail = b;
+  bcache.lruhead = b;
+  b->onlru = 1;
+}
+
+// Look for the block in bucket k.  k->lock must be held.
+static struct buf*
+bucketfind(struct bucket *k, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = k->head; b != 0; b = b->next)
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  return 0;
+}
+
+// Put b on the free list.  evictlock must be held.
+static void
+freebuf(struct buf *b)
+{
+  b->flags = B_FREE;
+  b->next = bcache.free;
+  bcache.free = b;
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  struct bucket *k;
 
-  initlock(&bcache.lock, "bcache");
+  initlock(&bcache.evictlock, "bcache");
+  initlock(&bcache.lrulock, "bcache.lru");
+  for(k = bcache.bucket; k < &bcache.bucket[NBUCKET]; k++)
+    initlock(&k->lock, "bcache.bucket");
+  bcache.maxpages = PHYSTOP / PGSIZE * BCACHEPCT / 100;
 
 //PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    freebuf(b);
   }
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
+// Add a page of buffers to the free list, if the cache may
+// grow and there is memory.  evictlock must be held.
+static void
+bgrow(void)
+{
+  struct bpage *pg;
+  struct buf *b;
+
+  if(bcache.npages >= bcache.maxpages)
+    return;
+  if((pg = (struct bpage*)kalloc()) == 0)
+    return;
+  for(b = pg->buf; b < &pg->buf[BPERPAGE]; b++){
+    initsleeplock(&b->lock, "buffer");
+    b->refcnt = 0;
+    b->done = 0;
+    b->onlru = 0;
+    freebuf(b);
+  }
+  pg->next = bcache.pages;
+  bcache.pages = pg;
+  bcache.npages++;
+}
+
+// Take the least recently used unused buffer out of its
+// bucket, or return 0 if all are in use.  evictlock must be held.
 static struct buf*
-bget(uint dev, uint blockno)
+bvictim(void)
 {
+  struct bucket *k;
   struct buf *b;
 
-  acquire(&bcache.lock);
+  for(;;){
+    acquire(&bcache.lrulock);
+    if((b = bcache.lrutail) == 0){
+      release(&bcache.lrulock);
+      return 0;
+    }
+    lrudel(b);
+    release(&bcache.lrulock);
 
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
+    // Only evictlock holders change b's block, so k stays
+    // right, but b may have been looked up or released again
+    // in between.
+    // Even if refcnt==0, B_DIRTY indicates a buffer is in use
+    // because log.c has modified it but not yet committed it.
+    k = &bcache.bucket[BHASH(b->dev, b->blockno)];
+    acquire(&k->lock);
+    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0){
+      bucketdel(k, b);
+      acquire(&bcache.lrulock);
+      lrudel(b);
+      release(&bcache.lrulock);
+      release(&k->lock);
       return b;
     }
+    release(&k->lock);
   }
+}
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+static void bdone(struct buf*);
+
+// Take a reference to b, which is cached, so it is no longer
+// a candidate for recycling.  b's bucket lock must be held.
+static void
+bref(struct buf *b)
+{
+  if(b->refcnt++ == 0){
+    acquire(&bcache.lrulock);
+    lrudel(b);
+    release(&bcache.lrulock);
+  }
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.  In either case, return
+// it with a new reference, not locked.  If ahead is set, the
+// block is only wanted if it is not cached: return 0 if it
+// is, or if there is no buffer to spare.
+static struct buf*
+blookup(uint dev, uint blockno, int ahead)
+{
+  struct bucket *k;
+  struct buf *b;
+
+  k = &bcache.bucket[BHASH(dev, blockno)];
+  acquire(&k->lock);
+
+  // Is the block already cached?
+  if((b = bucketfind(k, dev, blockno)) != 0){
+    if(!ahead)
+      bref(b);
+    release(&k->lock);
+    return ahead ? 0 : b;
+  }
+  release(&k->lock);
+
+  // Not cached; use a free buffer, growing the cache if need
+  // be, or recycle an unused one.  Look again with evictlock
+  // held, in case another process just loaded the block.
+  acquire(&bcache.evictlock);
+  acquire(&k->lock);
+  if((b = bucketfind(k, dev, blockno)) != 0){
+    if(!ahead)
+      bref(b);
+    release(&k->lock);
+    release(&bcache.evictlock);
+    return ahead ? 0 : b;
+  }
+  release(&k->lock);
+
+  if(bcache.free == 0)
+    bgrow();
+  if((b = bcache.free) != 0)
+    bcache.free = b->next;
+  else if((b = bvictim()) == 0){
+    if(!ahead)
+      panic("bget: no buffers");
+    release(&bcache.evictlock);
+    return 0;
+  }
+
+  b->dev = dev;
+  b->blockno = blockno;
+  b->flags = 0;
+  b->refcnt = 1;
+  acquire(&k->lock);
+  bucketadd(k, b);
+  release(&k->lock);
+  release(&bcache.evictlock);
+  return b;
+}
+
+// Return a locked buffer for the block.
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = blookup(dev, blockno, 0);
+  acquiresleep(&b->lock);
+  return b;
+}
+
+// Free one page of buffers that are all unused and clean, for
+// kalloc when memory runs out.  Returns 1 if a page was freed,
+// 0 if none could be.
+int
+bshrink(void)
+{
+  struct bpage *pg, **pp;
+  struct buf *b, **bp;
+  struct bucket *k;
+  int busy;
+
+  if(holding(&bcache.evictlock))
+    return 0;  // bgrow is allocating
+  acquire(&bcache.evictlock);
+  for(pp = &bcache.pages; (pg = *pp) != 0; pp = &pg->next){
+    busy = 0;
+    for(b = pg->buf; b < &pg->buf[BPERPAGE] && !busy; b++){
+      if(b->flags & B_FREE)
+        continue;
+      k = &bcache.bucket[BHASH(b->dev, b->blockno)];
+      acquire(&k->lock);
+      busy = b->refcnt != 0 || (b->flags & B_DIRTY) != 0;
+      release(&k->lock);
     }
+    if(busy)
+      continue;
+
+    // Take the page's buffers out of the buckets.  One may
+    // have been picked up since it was looked at; if so, the
+    // ones already taken out are just left free.
+    for(b = pg->buf; b < &pg->buf[BPERPAGE]; b++){
+      if(b->flags & B_FREE)
+        continue;
+      k = &bcache.bucket[BHASH(b->dev, b->blockno)];
+      acquire(&k->lock);
+      if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0){
+        bucketdel(k, b);
+        acquire(&bcache.lrulock);
+        lrudel(b);
+        release(&bcache.lrulock);
+        freebuf(b);
+      } else
+        busy = 1;
+      release(&k->lock);
+    }
+    if(busy)
+      continue;
+    for(bp = &bcache.free; *bp != 0; ){
+      if(PGROUNDDOWN((uint)*bp) == (uint)pg)
+        *bp = (*bp)->next;
+      else
+        bp = &(*bp)->next;
+    }
+    *pp = pg->next;
+    bcache.npages--;
+    release(&bcache.evictlock);
+    kfree((char*)pg);
+    return 1;
   }
-  panic("bget: no buffers");
+  release(&bcache.evictlock);
+  return 0;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -105,6 +398,63 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Start reading the block into the cache, if it is not there
+// already, and return without waiting for it.  The disk
+// driver releases the buffer when it is done (see bdone).
+void
+bprefetch(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = blookup(dev, blockno, 1)) == 0)
+    return;
+  // b is already in its bucket, so a bget of the same block
+  // may have locked and read it first.
+  acquiresleep(&b->lock);
+  if(b->flags & B_VALID){
+    brelse(b);
+    return;
+  }
+  b->done = bdone;
+  ideasync(b);
+}
+
+// Return a locked buf for the indicated block, and start
+// reading it from disk if it is not cached, without waiting.
+// Call bwait before using the data.
+struct buf*
+bread_async(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  if((b->flags & B_VALID) == 0)
+    ideasync(b);
+  return b;
+}
+
+// Start writing b's contents to disk, without waiting.
+// Must be locked; call bwait before releasing it.
+void
+bwrite_async(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwrite_async");
+  b->flags |= B_DIRTY;
+  ideasync(b);
+}
+
+// Wait for the transfer started by bread_async or
+// bwrite_async on b, if any, to finish.  Safe to call when
+// none was started.
+void
+bwait(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwait");
+  ideawait(b);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -115,8 +465,27 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
+// Drop a reference to b, putting it on the LRU list for
+// recycling if no one else holds it and it is clean.
+static void
+bput(struct buf *b)
+{
+  struct bucket *k;
+
+  k = &bcache.bucket[BHASH(b->dev, b->blockno)];
+  acquire(&k->lock);
+  b->refcnt--;
+  if (b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
+    // no one is waiting for it.
+    acquire(&bcache.lrulock);
+    lruadd(b);
+    release(&bcache.lrulock);
+  }
+  
+  release(&k->lock);
+}
+
 // Release a locked buffer.
-// Move to the head of the MRU list.
 void
 brelse(struct buf *b)
 {
@@ -124,20 +493,17 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
+  bput(b);
+}
 
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+// Completion callback for bprefetch: release b for the
+// process that started reading it.  Called by the disk
+// driver, perhaps from an interrupt.
+static void
+bdone(struct buf *b)
+{
+  releasesleep(&b->lock);
+  bput(b);
 }
 //PAGEBREAK!
 // Blank page.
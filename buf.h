@@ -4,11 +4,17 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  struct buf *prev; // hash bucket list
   struct buf *next;
+  struct buf *lruprev; // list of unused buffers, for recycling
+  struct buf *lrunext;
+  int onlru;        // on that list?
   struct buf *qnext; // disk queue
+  void (*done)(struct buf*); // if set, called when the disk is done
   uchar data[BSIZE];
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_FREE  0x8  // buffer holds no block; see bio.c
+#define B_BUSY  0x10 // request queued on or in progress at the disk
 
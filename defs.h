@@ -7,14 +7,26 @@ struct proc;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
+struct exitinfo;
+struct procinfo;
+struct rusage;
+struct shm;
+struct schedattr;
 struct stat;
 struct superblock;
+struct timer;
+struct vma;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+int             bshrink(void);
+void            bprefetch(uint, uint);
+struct buf*     bread_async(uint, uint);
+void            bwrite_async(struct buf*);
+void            bwait(struct buf*);
 
 // console.c
 void            consoleinit(void);
@@ -40,6 +52,8 @@ int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+void            iallowwrite(struct inode*);
+void            idenywrite(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -57,6 +71,8 @@ int             writei(struct inode*, char*, uint, uint);
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            ideasync(struct buf*);
+void            ideawait(struct buf*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -68,6 +84,10 @@ char*           kalloc(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+char*           kzalloc(void);
+void            kref(char*);
+int             krefcnt(char*);
+void            kzerofill(void);
 
 // kbd.c
 void            kbdintr(void);
@@ -101,6 +121,17 @@ void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
 
+// pcache.c
+void            pcacheinit(void);
+char*           pcacheget(struct inode*, uint);
+void            pcacheinval(struct inode*);
+
+// shm.c
+void            shminit(void);
+struct shm*     shmopen(int, uint);
+void            shmdup(struct shm*);
+void            shmclose(struct shm*);
+
 //PAGEBREAK: 16
 // proc.c
 int             cpuid(void);
@@ -118,6 +149,7 @@ void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
+int             wait2(struct rusage*);
 void            wakeup(void*);
 void            yield(void);
 int             cps(void);
@@ -125,6 +157,14 @@ int             chpr(int pid,int priority);
 int		setTime(int pid, int priority, int startHour, int startMin, int endHour, int endMin, int deadlineHour, int deadlineMin);
 int		checkTime(int hour, int min);
 int		checkPr(void);
+int		setEdf(int pid, int budget, int period);
+void		schedtick(int);
+void		schedexec(struct proc*);
+int		setSched(int pid, struct schedattr*);
+int		getSched(int pid, struct schedattr*);
+int		getrusage(int pid, struct rusage*);
+int		procinfo(struct procinfo*, int);
+int		exitinfo(struct exitinfo*, int);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -156,6 +196,7 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argwptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
@@ -163,6 +204,13 @@ void            syscall(void);
 
 // timer.c
 void            timerinit(void);
+uint            wallclock(void);
+void            walltime(struct rtcdate*);
+uint            localtick(int, int);
+uint            localtoday(int, int);
+void            timerset(struct timer*, uint);
+void            timerdel(struct timer*);
+void            timerfire(void);
 
 // trap.c
 void            idtinit(void);
@@ -184,8 +232,20 @@ int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
-pde_t*          copyuvm(pde_t*, uint);
+pde_t*          copyuvm(pde_t*, uint, struct vma*);
+int             cowfault(pde_t*, uint);
+int             lazyfault(struct proc*, uint, int);
+int             uvmprefault(struct proc*, uint, uint, int);
+uint            uvmlimit(struct proc*, uint);
+struct vma*     vmafind(struct proc*, uint);
+void            vmaflush(pde_t*, struct vma*);
+uint            mmapbase(struct proc*);
+uint            mmap(struct file*, uint, int, int, uint);
+int             munmap(uint, uint);
+int             vmaadd(struct vma*, uint, uint, struct inode*, uint, uint, int);
+void            vmadup(struct vma*, struct vma*);
+void            vmafree(struct vma*);
+int             pagefault(uint, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
@@ -2,6 +2,8 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "defs.h"
 #include "x86.h"
@@ -17,6 +19,7 @@ exec(char *path, char **argv)
   struct inode *ip;
   struct proghdr ph;
   pde_t *pgdir, *oldpgdir;
+  struct vma vmas[NVMA], *v;
   struct proc *curproc = myproc();
 
   begin_op();
@@ -28,6 +31,7 @@ exec(char *path, char **argv)
   }
   ilock(ip);
   pgdir = 0;
+  memset(vmas, 0, sizeof(vmas));
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -38,7 +42,8 @@ exec(char *path, char **argv)
   if((pgdir = setupkvm()) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Map the program.  Its pages are read from ip
+  // when first touched; see lazyfault.
   sz = 0;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
@@ -49,12 +54,21 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz >= KERNBASE)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(vmaadd(vmas, ph.vaddr, ph.vaddr + ph.memsz, ip, ph.off, ph.filesz, PTE_W) < 0)
       goto bad;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
+  }
+  // Writing to ip now would change pages not yet read in.
+  for(v = vmas; v < &vmas[NVMA]; v++){
+    if(v->flags){
+      v->flags |= VMA_EXEC;
+      idenywrite(ip);
+    }
   }
   iunlockput(ip);
   end_op();
@@ -99,10 +113,15 @@ exec(char *path, char **argv)
   curproc->sz = sz;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
-  curproc->priority = 1;
   curproc->timePriority = 1;
+  schedexec(curproc);
   switchuvm(curproc);
+  vmaflush(oldpgdir, curproc->vma);
   freevm(oldpgdir);
+  begin_op();
+  vmafree(curproc->vma);
+  end_op();
+  memmove(curproc->vma, vmas, sizeof(vmas));
   return 0;
 
  bad:
@@ -112,5 +131,8 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  begin_op();
+  vmafree(vmas);
+  end_op();
   return -1;
 }
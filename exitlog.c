@@ -0,0 +1,24 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "param.h"
+#include "procinfo.h"
+
+// Print the statistics of recently reaped processes,
+// which wait() no longer prints to the console.
+
+struct exitinfo ei[NEXITLOG];
+
+int
+main(int argc,char *argv[])
+{
+  int i, n;
+
+  n = exitinfo(ei, NEXITLOG);
+  printf(1, "name \t pid \t CPU ticks \t wait ticks \t memory \t exited\n");
+  for(i = 0; i < n; i++)
+    printf(1, "%s\t %d  \t %d \t\t %d \t\t %d \t\t %d\n",
+      ei[i].name, ei[i].pid, ei[i].ticks, ei[i].wtime, ei[i].sz, ei[i].when);
+  exit();
+}
@@ -76,7 +76,8 @@ fileclose(struct file *f)
     begin_op();
     iput(ff.ip);
     end_op();
-  }
+  } else if(ff.type == FD_SHM)
+    shmclose(ff.shm);
 }
 
 // Get metadata about file f.
@@ -109,6 +110,8 @@ fileread(struct file *f, char *addr, int n)
     iunlock(f->ip);
     return r;
   }
+  if(f->type == FD_SHM)
+    return -1;  // use mmap
   panic("fileread");
 }
 
@@ -152,6 +155,8 @@ filewrite(struct file *f, char *addr, int n)
     }
     return i == n ? n : -1;
   }
+  if(f->type == FD_SHM)
+    return -1;  // use mmap
   panic("filewrite");
 }
 
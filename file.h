@@ -1,10 +1,11 @@
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_SHM } type;
   int ref; // reference count
   char readable;
   char writable;
   struct pipe *pipe;
   struct inode *ip;
+  struct shm *shm;
   uint off;
 };
 
@@ -14,6 +15,7 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  int denywrite;      // Exec regions mapping it; writes fail while > 0
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -23,6 +25,9 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+
+  uint ranext;        // read-ahead: block a sequential read reads next
+  uint raend;         // read-ahead: blocks before this are prefetched
 };
 
 // table mapping major device number to
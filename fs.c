@@ -14,8 +14,9 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
@@ -159,6 +160,8 @@ bfree(int dev, uint b)
 // entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold icache.lock while using any of those fields.
+// It also protects ip->denywrite, which counts the regions of
+// running programs that page in from the inode (see exec).
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
@@ -267,6 +270,8 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->ranext = 0;
+  ip->raend = 0;
   release(&icache.lock);
 
   return ip;
@@ -283,6 +288,27 @@ idup(struct inode *ip)
   return ip;
 }
 
+// Refuse writes to ip while a program runs from it, since its
+// pages are read from the file as they are first touched.
+void
+idenywrite(struct inode *ip)
+{
+  acquire(&icache.lock);
+  ip->denywrite++;
+  release(&icache.lock);
+}
+
+// Undo one idenywrite.
+void
+iallowwrite(struct inode *ip)
+{
+  acquire(&icache.lock);
+  if(ip->denywrite < 1)
+    panic("iallowwrite");
+  ip->denywrite--;
+  release(&icache.lock);
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
@@ -433,6 +459,7 @@ itrunc(struct inode *ip)
 
   ip->size = 0;
   iupdate(ip);
+  pcacheinval(ip);
 }
 
 // Copy stat information from inode.
@@ -447,6 +474,25 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Start reading up to NREADAHEAD blocks of ip from block bn
+// on, so they are cached by the time a sequential reader
+// gets to them.  Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, uint bn)
+{
+  uint end, nblocks;
+
+  nblocks = (ip->size + BSIZE - 1) / BSIZE;
+  end = bn + NREADAHEAD;
+  if(end > nblocks)
+    end = nblocks;
+  if(ip->raend > bn)
+    bn = ip->raend;
+  for(; bn < end; bn++)
+    bprefetch(ip->dev, bmap(ip, bn));
+  ip->raend = bn;
+}
+
 //PAGEBREAK!
 // Read data from inode.
 // Caller must hold ip->lock.
@@ -467,11 +513,18 @@ readi(struct inode *ip, char *dst, uint off, uint n)
   if(off + n > ip->size)
     n = ip->size - off;
 
+  // A read that starts where the last one stopped is taken
+  // to be sequential.
+  if(off/BSIZE != ip->ranext)
+    ip->raend = 0;
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    if(off/BSIZE == ip->ranext)
+      readahead(ip, off/BSIZE + 1);
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(dst, bp->data + off%BSIZE, m);
     brelse(bp);
+    ip->ranext = (off + m) / BSIZE;
   }
   return n;
 }
@@ -495,7 +548,14 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  acquire(&icache.lock);
+  if(ip->denywrite > 0){
+    release(&icache.lock);
+    return -1;
+  }
+  release(&icache.lock);
 
+  pcacheinval(ip);
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
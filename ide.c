@@ -5,10 +5,11 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
@@ -23,16 +24,31 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
 
-// idequeue points to the buf now being read/written to the disk.
-// idequeue->qnext points to the next buf to be processed.
+#define IDE_MAXMULT   16   // most sectors per READ/WRITE MULTIPLE block
+
+// Requests are served in C-LOOK order: idequeue holds the
+// waiting bufs sorted by block number, first those at or
+// after idepos, the block where the disk last started, in
+// ascending order, then those before it, also ascending.
+// The disk thus sweeps upward and jumps back to the lowest
+// block.  Runs of adjacent blocks at the head of the queue
+// going the same way are merged into one command of up to
+// idemult sectors, the drive's READ/WRITE MULTIPLE block
+// size, so they take a single interrupt.
+// ideactive points to the bufs of the command now in
+// progress, linked through qnext.
 // You must hold idelock while manipulating queue.
 
 static struct spinlock idelock;
 static struct buf *idequeue;
+static struct buf *ideactive;
+static uint idepos;
+static int idemult = 1;
 
 static int havedisk1;
-static void idestart(struct buf*);
+static void idestart(void);
 
 // Wait for IDE disk to become ready.
 static int
@@ -47,6 +63,18 @@ idewait(int checkerr)
   return 0;
 }
 
+// Set the READ/WRITE MULTIPLE block size of disk d to n
+// sectors.  Returns -1 if the disk does not support it.
+static int
+idesetmult(int d, int n)
+{
+  outb(0x1f6, 0xe0 | (d<<4));
+  idewait(0);
+  outb(0x1f2, n);
+  outb(0x1f7, IDE_CMD_SETMUL);
+  return idewait(1);
+}
+
 void
 ideinit(void)
 {
@@ -65,35 +93,62 @@ ideinit(void)
     }
   }
 
+  // Turn on multiple-sector transfers, with the disk's
+  // interrupt off so that the command does not raise one.
+  outb(0x3f6, 2);
+  if(idesetmult(0, IDE_MAXMULT) >= 0 &&
+     (!havedisk1 || idesetmult(1, IDE_MAXMULT) >= 0))
+    idemult = IDE_MAXMULT;
+
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Start the request at the head of idequeue, merged with the
+// adjacent ones after it.  Caller must hold idelock.
 static void
-idestart(struct buf *b)
+idestart(void)
 {
-  if(b == 0)
+  struct buf *b, *last;
+  int n;
+
+  if((b = idequeue) == 0)
     panic("idestart");
   if(b->blockno >= FSSIZE)
     panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
-  int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
-  int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
 
   if (sector_per_block > 7) panic("idestart");
 
+  // Take the run of requests to merge off the queue.
+  last = b;
+  for(n = 1; last->qnext != 0 && (n+1)*sector_per_block <= idemult; n++){
+    if(last->qnext->dev != b->dev || last->qnext->blockno != last->blockno + 1 ||
+       (last->qnext->flags & B_DIRTY) != (b->flags & B_DIRTY))
+      break;
+    last = last->qnext;
+  }
+  idequeue = last->qnext;
+  last->qnext = 0;
+  ideactive = b;
+  idepos = b->blockno;
+
+  int nsect = n * sector_per_block;
+  int read_cmd = (nsect == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
+  int write_cmd = (nsect == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
+
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, nsect);  // number of sectors
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
   if(b->flags & B_DIRTY){
     outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
+    for(; b != 0; b = b->qnext)
+      outsl(0x1f0, b->data, BSIZE/4);
   } else {
     outb(0x1f7, read_cmd);
   }
@@ -103,39 +158,53 @@ idestart(struct buf *b)
 void
 ideintr(void)
 {
-  struct buf *b;
+  struct buf *b, *donebuf[IDE_MAXMULT];
+  void (*done[IDE_MAXMULT])(struct buf*);
+  int i, n, ok;
 
-  // First queued buffer is the active request.
+  // ideactive is the request that finished.
   acquire(&idelock);
 
-  if((b = idequeue) == 0){
+  if((b = ideactive) == 0){
     release(&idelock);
     return;
   }
-  idequeue = b->qnext;
+  ideactive = 0;
 
   // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+  ok = !(b->flags & B_DIRTY) && idewait(1) >= 0;
 
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
+  for(n = 0; b != 0; b = b->qnext){
+    if(ok)
+      insl(0x1f0, b->data, BSIZE/4);
+
+    // Wake process waiting for this buf.  Once idelock is
+    // released b may be reused, so take its callback now.
+    if(b->done){
+      donebuf[n] = b;
+      done[n++] = b->done;
+      b->done = 0;
+    }
+    b->flags |= B_VALID;
+    b->flags &= ~(B_DIRTY|B_BUSY);
+    wakeup(b);
+  }
 
   // Start disk on next buf in queue.
   if(idequeue != 0)
-    idestart(idequeue);
+    idestart();
 
   release(&idelock);
+
+  for(i = 0; i < n; i++)
+    done[i](donebuf[i]);
 }
 
 //PAGEBREAK!
-// Sync buf with disk.
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
-void
-iderw(struct buf *b)
+// Queue the request for b, starting the disk if it is idle.
+// Caller must hold idelock.
+static void
+ideappend(struct buf *b)
 {
   struct buf **pp;
 
@@ -146,17 +215,57 @@ iderw(struct buf *b)
   if(b->dev != 0 && !havedisk1)
     panic("iderw: ide disk 1 not present");
 
-  acquire(&idelock);  //DOC:acquire-lock
-
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-    ;
+  // Insert b in C-LOOK order: in the upward sweep if it is at
+  // or after idepos, else in the next one.
+  for(pp=&idequeue; *pp; pp=&(*pp)->qnext){  //DOC:insert-queue
+    if(b->blockno >= idepos){
+      if((*pp)->blockno < idepos || (*pp)->blockno > b->blockno)
+        break;
+    } else if((*pp)->blockno < idepos && (*pp)->blockno > b->blockno)
+      break;
+  }
+  b->qnext = *pp;
   *pp = b;
+  b->flags |= B_BUSY;
 
   // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
+  if(ideactive == 0)
+    idestart();
+}
+
+// Start syncing buf with disk, as iderw does, but return at
+// once.  Several requests may be outstanding.  When the disk
+// is done, ideintr calls b->done, if set, without idelock held.
+void
+ideasync(struct buf *b)
+{
+  acquire(&idelock);
+  ideappend(b);
+  release(&idelock);
+}
+
+// Wait for the request for b started by ideasync, if there
+// is one, to finish.  A buffer nothing was started for, such
+// as a cached block log_write() has marked dirty, returns at once.
+void
+ideawait(struct buf *b)
+{
+  acquire(&idelock);
+  while(b->flags & B_BUSY){
+    sleep(b, &idelock);
+  }
+  release(&idelock);
+}
+
+// Sync buf with disk.
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+void
+iderw(struct buf *b)
+{
+  acquire(&idelock);  //DOC:acquire-lock
+
+  ideappend(b);
 
   // Wait for request to finish.
   while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
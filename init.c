@@ -4,6 +4,7 @@
 #include "stat.h"
 #include "user.h"
 #include "fcntl.h"
+#include "sched.h"
 
 char *argv[] = { "sh", 0 };
 
@@ -11,6 +12,7 @@ int
 main(void)
 {
   int pid, wpid;
+  struct schedattr attr;
 
   if(open("console", O_RDWR) < 0){
     mknod("console", 1, 1);
@@ -27,16 +29,17 @@ main(void)
       exit();
     }
     if(pid == 0){
+      // The shell is interactive: boost it when it starts.
+      if(getSched(0, &attr) == 0){
+        attr.flags |= SCHED_INTERACTIVE;
+        setSched(0, &attr);
+      }
       exec("sh", argv);
       printf(1, "init: exec sh failed\n");
       exit();
     }
     while((wpid=wait()) >= 0 && wpid != pid)
       //printf(1, "%d zombie!\n", wpid);
-    {
-	checkPr();
-	//printf(1, "pid=%d finished\n", wpid);
-	//printf(1, "---------------\n");
-    }
+      ;
   }
 }
@@ -8,6 +8,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "x86.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
@@ -17,21 +18,49 @@ struct run {
   struct run *next;
 };
 
+#define KBATCH 32  // pages moved between a cpu cache and the pool at once
+#define NZERO  64  // pre-zeroed pages kept for kzalloc
+
+// Each cpu keeps a cache of free pages, so the common kalloc
+// and kfree take only that cpu's lock.  The cache refills from
+// and drains to the shared pool KBATCH pages at a time.
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+};
+
 struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  struct kcache cpu[NCPU];
+  uint ref[PHYSTOP/PGSIZE];  // Mappings of each page; see kref
 } kmem;
 
+// Pages zeroed ahead of time by idle cpus; see kzerofill.
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+} kzero;
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
 // 2. main() calls kinit2() with the rest of the physical pages
 // after installing a full page table that maps them on all cores.
+// Until then there is one cpu and no lock, and pages go straight
+// to the shared pool.
 void
 kinit1(void *vstart, void *vend)
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  initlock(&kzero.lock, "kzero");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kmem.cpu[i].lock, "kcache");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -51,46 +80,224 @@ freerange(void *vstart, void *vend)
   for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
     kfree(p);
 }
+
+// Lock and return this cpu's cache.
+static struct kcache*
+kcachelock(void)
+{
+  struct kcache *c;
+
+  pushcli();
+  c = &kmem.cpu[cpuid()];
+  acquire(&c->lock);
+  popcli();
+  return c;
+}
+
+// Move up to KBATCH pages from the shared pool to c.
+// c->lock must be held.
+static void
+refill(struct kcache *c)
+{
+  struct run *r;
+  int n;
+
+  n = KBATCH;
+  acquire(&kmem.lock);
+  while(n-- > 0 && (r = kmem.freelist) != 0){
+    kmem.freelist = r->next;
+    r->next = c->freelist;
+    c->freelist = r;
+    c->n++;
+  }
+  release(&kmem.lock);
+}
+
+// Move KBATCH pages from c to the shared pool.
+// c->lock must be held and c must hold more than KBATCH pages.
+static void
+drain(struct kcache *c)
+{
+  struct run *head, *tail;
+  int n;
+
+  head = tail = c->freelist;
+  for(n = 1; n < KBATCH; n++)
+    tail = tail->next;
+  c->freelist = tail->next;
+  c->n -= KBATCH;
+  acquire(&kmem.lock);
+  tail->next = kmem.freelist;
+  kmem.freelist = head;
+  release(&kmem.lock);
+}
+
+// Take a page from the zeroed pool, or 0 if it is empty.
+static struct run*
+kzeropop(void)
+{
+  struct run *r;
+
+  acquire(&kzero.lock);
+  if((r = kzero.freelist) != 0){
+    kzero.freelist = r->next;
+    kzero.n--;
+  }
+  release(&kzero.lock);
+  if(r)
+    r->next = 0;
+  return r;
+}
+
+// Take a page from some other cpu's cache, or failing that
+// the zeroed pool, when both this cpu's cache and the shared
+// pool are empty.
+static struct run*
+ksteal(void)
+{
+  struct kcache *c;
+  struct run *r;
+
+  for(c = kmem.cpu; c < &kmem.cpu[NCPU]; c++){
+    acquire(&c->lock);
+    r = c->freelist;
+    if(r){
+      c->freelist = r->next;
+      c->n--;
+    }
+    release(&c->lock);
+    if(r)
+      return r;
+  }
+  return kzeropop();
+}
+
 //PAGEBREAK: 21
+// Reference counts.  kalloc returns a page with one reference;
+// kref adds one for each extra page table entry (or other user)
+// that shares it, and kfree drops one, freeing the page with
+// the last.  Counts change with atomic adds, so sharing a page
+// takes no lock.
+
+static uint*
+refp(char *v)
+{
+  return &kmem.ref[V2P(v) / PGSIZE];
+}
+
+// Add a reference to page v, which must already have one.
+void
+kref(char *v)
+{
+  xadd(refp(v), 1);
+}
+
+// Number of references to page v.
+int
+krefcnt(char *v)
+{
+  return *refp(v);
+}
+
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// call to kalloc(), once no other reference to it remains.
+// (The exception is when initializing the allocator;
+// see kinit above.)
 void
 kfree(char *v)
 {
   struct run *r;
+  struct kcache *c;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
+  if(*refp(v) > 0 && xadd(refp(v), -1) > 1)
+    return;
 
   // Fill with junk to catch dangling refs.
-  memset(v, 1, PGSIZE);
+  if(KJUNK)
+    memset(v, 1, PGSIZE);
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+  if(!kmem.use_lock){
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+    return;
+  }
+  c = kcachelock();
+  r->next = c->freelist;
+  c->freelist = r;
+  if(++c->n > 2*KBATCH)
+    drain(c);
+  release(&c->lock);
 }
 
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
-// Returns 0 if the memory cannot be allocated.
+// Returns 0 if the memory cannot be allocated, even after
+// taking idle pages back from the buffer cache.
 char*
 kalloc(void)
 {
   struct run *r;
+  struct kcache *c;
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  r = kmem.freelist;
+  if(!kmem.use_lock){
+    r = kmem.freelist;
+    if(r){
+      kmem.freelist = r->next;
+      *refp((char*)r) = 1;
+    }
+    return (char*)r;
+  }
+  c = kcachelock();
+  if(c->freelist == 0)
+    refill(c);
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->n--;
+  }
+  release(&c->lock);
+  if(r == 0)
+    r = ksteal();
+  if(r == 0 && bshrink())
+    return kalloc();
   if(r)
-    kmem.freelist = r->next;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+    *refp((char*)r) = 1;
   return (char*)r;
 }
 
+// Allocate a page filled with zeros, from the pool that idle
+// cpus keep if it has one.
+char*
+kzalloc(void)
+{
+  char *v;
+
+  if(kmem.use_lock && kzero.n > 0 && (v = (char*)kzeropop()) != 0)
+    return v;
+  if((v = kalloc()) != 0)
+    memset(v, 0, PGSIZE);
+  return v;
+}
+
+// Zero a page for the kzalloc pool if it is short of NZERO.
+// The scheduler calls this when it has nothing to run.
+void
+kzerofill(void)
+{
+  struct run *r;
+
+  if(!kmem.use_lock || kzero.n >= NZERO)
+    return;
+  if((r = (struct run*)kalloc()) == 0)
+    return;
+  memset(r, 0, PGSIZE);
+  acquire(&kzero.lock);
+  r->next = kzero.freelist;
+  kzero.freelist = r;
+  kzero.n++;
+  release(&kzero.lock);
+}
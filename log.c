@@ -65,19 +65,29 @@ initlog(int dev)
   recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location.
+// All the reads are started at once, and then all the writes,
+// so the disk always has the rest queued.
 static void
 install_trans(void)
 {
+  struct buf *lbuf[LOGSIZE], *dbuf[LOGSIZE];
   int tail;
 
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    brelse(lbuf);
-    brelse(dbuf);
+    lbuf[tail] = bread_async(log.dev, log.start+tail+1); // read log block
+    dbuf[tail] = bread_async(log.dev, log.lh.block[tail]); // read dst
+  }
+  for (tail = 0; tail < log.lh.n; tail++) {
+    bwait(lbuf[tail]);
+    bwait(dbuf[tail]);
+    memmove(dbuf[tail]->data, lbuf[tail]->data, BSIZE);  // copy block to dst
+    bwrite_async(dbuf[tail]);  // write dst to disk
+    brelse(lbuf[tail]);
+  }
+  for (tail = 0; tail < log.lh.n; tail++) {
+    bwait(dbuf[tail]);
+    brelse(dbuf[tail]);
   }
 }
 
@@ -173,19 +183,26 @@ end_op(void)
   }
 }
 
-// Copy modified blocks from cache to log.
+// Copy modified blocks from cache to log, with all the
+// log writes in flight at once.
 static void
 write_log(void)
 {
+  struct buf *to[LOGSIZE];
   int tail;
 
+  for (tail = 0; tail < log.lh.n; tail++)
+    to[tail] = bread_async(log.dev, log.start+tail+1); // log block
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+    bwait(to[tail]);
+    memmove(to[tail]->data, from->data, BSIZE);
+    bwrite_async(to[tail]);  // write the log
     brelse(from);
-    brelse(to);
+  }
+  for (tail = 0; tail < log.lh.n; tail++) {
+    bwait(to[tail]);
+    brelse(to[tail]);
   }
 }
 
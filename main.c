@@ -3,6 +3,8 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "x86.h"
 
@@ -29,7 +31,10 @@ main(void)
   uartinit();      // serial port
   pinit();         // process table
   tvinit();        // trap vectors
+  timerinit();     // wall clock
   binit();         // buffer cache
+  pcacheinit();    // shared program pages
+  shminit();       // shared memory segments
   fileinit();      // file table
   ideinit();       // disk 
   startothers();   // start other processors
@@ -94,8 +99,6 @@ startothers(void)
     while(c->started == 0)
       ;
   }
-  int n = 0;
-  for(c = cpus; c < cpus+ncpu; c++){ c->cpuNum = n; n++;}
 }
 
 // The boot page table used in entry.S and entryother.S.
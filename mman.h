@@ -0,0 +1,7 @@
+// Protection and flags for mmap().
+#define PROT_READ   0x1
+#define PROT_WRITE  0x2
+
+#define MAP_SHARED  0x1   // Writes are seen by forked children, and by the file at munmap
+#define MAP_PRIVATE 0x2   // Writes are private to the process
+#define MAP_ANON    0x4   // Zeros, not a file; fd is ignored
@@ -9,6 +9,8 @@
 #include "mp.h"
 #include "x86.h"
 #include "mmu.h"
+#include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 
 struct cpu cpus[NCPU];
@@ -108,6 +110,7 @@ mpinit(void)
       proc = (struct mpproc*)p;
       if(ncpu < NCPU) {
         cpus[ncpu].apicid = proc->apicid;  // apicid may differ from ncpu
+        cpus[ncpu].cpuNum = ncpu;
         ncpu++;
       }
       p += sizeof(struct mpproc);
@@ -1,7 +1,14 @@
 #define NPROC        64  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          2  // maximum number of CPUs
+#define NPRIO        21  // number of priority levels (0-20)
+#define AGETICKS     10  // run queue wait that counts as one level higher
+#define EDFMAXUTIL   90  // percent of each CPU that EDF processes may reserve
 #define NOFILE       16  // open files per process
+#define NVMA         16  // demand-paged memory regions per process
+#define NPCACHE      64  // program file pages cached for sharing
+#define NSHM         16  // shared memory segments per system
+#define SHMPAGES     64  // maximum pages in a shared memory segment
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
@@ -9,6 +16,13 @@
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NBUF         (LOGSIZE*2+MAXOPBLOCKS)  // disk block cache buffers always kept
+#define BCACHEPCT    10  // percent of memory the block cache may grow to
+#define NREADAHEAD    8  // blocks readi() prefetches for sequential reads
 #define FSSIZE       1000  // size of file system in blocks
+#define HZ           100  // timer interrupts per second
+#define TIMEZONE       8  // hours east of UTC; setTime() uses local time
+#define NEXITLOG      64  // exit records kept for exitinfo()
+#define EXITDEBUG      0  // if 1, wait() also prints each exit record
+#define KJUNK          0  // if 1, kfree() fills pages with junk
 
@@ -0,0 +1,146 @@
+// Page cache for demand-paged program files.
+//
+// Processes running the same binary map the same physical
+// frames for the pages they only read, such as text: a region's
+// file pages come from here, keyed by (device, inode, offset),
+// and are mapped read-only.  If the region is writable the
+// mapping is also copy-on-write, so a write gets a private copy
+// (see cowfault) and the cached frame never changes.
+//
+// The cache holds one reference to each of its pages (see kref),
+// and each mapping one more.  Writing or truncating a file drops
+// its pages from the cache; mappings already made keep theirs.
+// Only whole pages are cached.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+struct pcpage {
+  uint dev;
+  uint inum;
+  uint off;        // File offset of the page
+  char *page;      // 0 if the slot is free
+  uint used;       // Value of pcache.clock at the last lookup
+};
+
+struct {
+  struct spinlock lock;
+  struct pcpage page[NPCACHE];
+  uint clock;      // Counts lookups, for LRU replacement
+  uint gen;        // Counts invalidations
+} pcache;
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+// Look up a page; pcache.lock must be held.
+static struct pcpage*
+pclookup(uint dev, uint inum, uint off)
+{
+  struct pcpage *c;
+
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++)
+    if(c->page && c->dev == dev && c->inum == inum && c->off == off)
+      return c;
+  return 0;
+}
+
+// Enter page v for (dev, inum, off), evicting the least
+// recently used page if the cache is full.
+// pcache.lock must be held.
+static void
+pcinsert(uint dev, uint inum, uint off, char *v)
+{
+  struct pcpage *c, *victim;
+
+  victim = 0;
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++){
+    if(c->page == 0){
+      victim = c;
+      break;
+    }
+    if(victim == 0 || (int)(c->used - victim->used) < 0)
+      victim = c;
+  }
+  if(victim->page)
+    kfree(victim->page);
+  victim->dev = dev;
+  victim->inum = inum;
+  victim->off = off;
+  victim->page = v;
+  victim->used = pcache.clock;
+  kref(v);
+}
+
+// Return the PGSIZE bytes of ip at off, in a page the caller
+// holds a reference to and must not write.  Reads the file if
+// the page is not cached, so may sleep; ip must not be locked.
+// Returns 0 if out of memory or the file is short.
+char*
+pcacheget(struct inode *ip, uint off)
+{
+  struct pcpage *c;
+  char *v;
+  uint gen;
+
+  acquire(&pcache.lock);
+  pcache.clock++;
+  if((c = pclookup(ip->dev, ip->inum, off)) != 0){
+    c->used = pcache.clock;
+    v = c->page;
+    kref(v);
+    release(&pcache.lock);
+    return v;
+  }
+  gen = pcache.gen;
+  release(&pcache.lock);
+
+  if((v = kalloc()) == 0)
+    return 0;
+  ilock(ip);
+  if(readi(ip, v, off, PGSIZE) != PGSIZE){
+    iunlock(ip);
+    kfree(v);
+    return 0;
+  }
+  iunlock(ip);
+
+  // Someone may have cached the page while we read it, or
+  // changed a file, in which case our copy may be stale for
+  // them; keep it private then.
+  acquire(&pcache.lock);
+  if((c = pclookup(ip->dev, ip->inum, off)) != 0){
+    kfree(v);
+    v = c->page;
+    kref(v);
+  } else if(gen == pcache.gen)
+    pcinsert(ip->dev, ip->inum, off, v);
+  release(&pcache.lock);
+  return v;
+}
+
+// Drop the cached pages of ip, whose contents are changing.
+void
+pcacheinval(struct inode *ip)
+{
+  struct pcpage *c;
+
+  acquire(&pcache.lock);
+  pcache.gen++;
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++){
+    if(c->page && c->dev == ip->dev && c->inum == ip->inum){
+      kfree(c->page);
+      c->page = 0;
+    }
+  }
+  release(&pcache.lock);
+}
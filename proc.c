@@ -4,28 +4,444 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
-#include "proc.h"
 #include "spinlock.h"
-#include "date.h"
+#include "rusage.h"
+#include "proc.h"
+#include "sched.h"
+#include "procinfo.h"
 
 #define NULL 0;
 struct {
-  struct spinlock lock;
+  struct spinlock lock;        // Protects p->parent and nextpid; see wait()
   struct proc proc[NPROC];
 } ptable;
 
 static struct proc *initproc;
 
+struct {
+  struct spinlock lock;
+  int util[NCPU];              // EDF load admitted per cpu, in 1/1000ths
+} edf;
+
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
+static void winstart(struct timer*, uint);
+static void winend(struct timer*, uint);
+static void deadlinehit(struct timer*, uint);
+static void edfrelease(struct timer*, uint);
+
+static void
+proctimer(struct timer *t, struct proc *p, void (*fn)(struct timer*, uint))
+{
+  t->idx = -1;
+  t->fn = fn;
+  t->proc = p;
+}
 
 void
 pinit(void)
 {
+  struct proc *p;
+  struct cpu *c;
+
   initlock(&ptable.lock, "ptable");
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    initlock(&p->lock, "proc");
+    proctimer(&p->starttimer, p, winstart);
+    proctimer(&p->endtimer, p, winend);
+    proctimer(&p->deadlinetimer, p, deadlinehit);
+    proctimer(&p->edftimer, p, edfrelease);
+  }
+  initlock(&edf.lock, "edf");
+  for(c = cpus; c < cpus+ncpu; c++)
+    initlock(&c->rq.lock, "runq");
+}
+
+//PAGEBREAK: 40
+// Run queues.  Every RUNNABLE process that is not currently
+// being switched to sits on exactly one cpu's run queue, at
+// level p->level.  Each level is kept sorted by deadline,
+// earliest first, so the head of the lowest non-empty level is
+// the process the old table scan would have chosen, and finding
+// it is a bsf and a dequeue.  A process joins the queue of the
+// cpu named by p->cpuNum, i.e. the one it last ran on; an idle
+// cpu steals from its busiest peer.
+//
+// EDF processes (p->edf) have their own list, sorted by absolute
+// deadline, which is served before any priority level.  They are
+// bound to the cpu that admitted them and are never stolen.
+//
+// A process's level is its priority.  Levels that have waited
+// long are served ahead of their turn (see Aging below).
+
+// Deadline in minutes of the day, for ordering within a level.
+static int
+deadlinekey(struct proc *p)
+{
+  return p->deadline[0] * 60 + p->deadline[1];
+}
+
+// Should a run before b?
+static int
+runqbefore(struct proc *a, struct proc *b)
+{
+  if(a->edf)
+    return (int)(a->edfdeadline - b->edfdeadline) < 0;
+  return deadlinekey(a) < deadlinekey(b);
+}
+
+// The list of rq that p belongs on.
+static struct proc**
+runqlist(struct runq *rq, struct proc *p)
+{
+  return p->edf ? &rq->edf : &rq->head[p->level];
+}
+
+// Link p into rq at the level its priority calls for.
+// rq->lock must be held.
+static void
+runqinsert(struct runq *rq, struct proc *p)
+{
+  struct proc **pp;
+
+  p->level = p->priority;
+  for(pp = runqlist(rq, p); *pp; pp = &(*pp)->rqnext)
+    if(runqbefore(p, *pp))
+      break;
+  p->rqnext = *pp;
+  *pp = p;
+  p->rq = rq;
+  if(!p->edf && !(rq->ready & (1 << p->level))){
+    rq->ready |= 1 << p->level;
+    rq->stamp[p->level] = ticks;
+  }
+  rq->n++;
+}
+
+// Queue p on rq.  p->lock must be held.
+static void
+runqadd(struct runq *rq, struct proc *p)
+{
+  if(p->rq)
+    panic("runqadd");
+
+  if(!p->edf){
+    if(p->priority < 0)
+      p->priority = 0;
+    if(p->priority >= NPRIO)
+      p->priority = NPRIO-1;
+  }
+
+  acquire(&rq->lock);
+  p->rqstamp = ticks;
+  runqinsert(rq, p);
+  release(&rq->lock);
+}
+
+// Unlink p from rq.  rq->lock must be held.
+static void
+runqunlink(struct runq *rq, struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = runqlist(rq, p); *pp != p; pp = &(*pp)->rqnext)
+    ;
+  *pp = p->rqnext;
+  p->rqnext = 0;
+  p->rq = 0;
+  if(!p->edf && rq->head[p->level] == 0)
+    rq->ready &= ~(1 << p->level);
+  rq->n--;
+}
+
+// Take p off its run queue, if it is on one, and return
+// the queue, or 0 if p was not queued.  p->lock must be held,
+// so p->rq can only change underneath us by a scheduler
+// popping p, in which case p is about to run anyway.
+static struct runq*
+runqdel(struct proc *p)
+{
+  struct runq *rq;
+  int queued;
+
+  if((rq = p->rq) == 0)
+    return 0;
+  acquire(&rq->lock);
+  queued = p->rq == rq;
+  if(queued)
+    runqunlink(rq, p);
+  release(&rq->lock);
+  return queued ? rq : 0;
+}
+
+// Aging.  So that a busy level cannot starve the levels below
+// it, each level counts as one level higher for every AGETICKS
+// it has gone without being served since it last was, or since
+// it filled.  The aging is worked out only when a process is
+// dequeued, from the stamps of the non-empty levels, so no
+// sweep of the queued processes is needed.
+
+// The level rq should serve next.  rq->ready must be non-zero
+// and rq->lock held.
+static int
+runqlevel(struct runq *rq)
+{
+  uint r;
+  int l, best, key, bestkey;
+
+  best = -1;
+  bestkey = 0;
+  for(r = rq->ready; r; r &= r - 1){
+    l = bsf(r);
+    key = l*AGETICKS - (int)(ticks - rq->stamp[l]);
+    if(best < 0 || key < bestkey){
+      best = l;
+      bestkey = key;
+    }
+  }
+  return best;
+}
+
+// Remove and return the process that should run next from rq,
+// or 0 if there is none.  EDF processes are only considered if
+// edfok is set.  The caller must then acquire p->lock before
+// touching p.
+static struct proc*
+runqpop(struct runq *rq, int edfok)
+{
+  struct proc *p;
+
+  if(rq->ready == 0 && (!edfok || rq->edf == 0))
+    return 0;
+  acquire(&rq->lock);
+  p = 0;
+  if(edfok && rq->edf)
+    p = rq->edf;
+  else if(rq->ready)
+    p = rq->head[runqlevel(rq)];
+  if(p){
+    runqunlink(rq, p);
+    if(!p->edf)
+      rq->stamp[p->level] = ticks;
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Pull a process from the peer with the longest run queue.
+// The queue lengths are read without locks; runqpop() copes
+// if the victim has emptied in the meantime.
+static struct proc*
+steal(struct cpu *c)
+{
+  struct cpu *busiest, *o;
+
+  busiest = 0;
+  for(o = cpus; o < cpus+ncpu; o++)
+    if(o != c && o->rq.n > 0 && (busiest == 0 || o->rq.n > busiest->rq.n))
+      busiest = o;
+  if(busiest == 0)
+    return 0;
+  return runqpop(&busiest->rq, 0);
+}
+
+// The cpu with the shortest run queue; where new processes start.
+static int
+idlestcpu(void)
+{
+  struct cpu *c, *best;
+
+  best = cpus;
+  for(c = cpus; c < cpus+ncpu; c++)
+    if(c->rq.n + (c->proc != 0) < best->rq.n + (best->proc != 0))
+      best = c;
+  return best->cpuNum;
+}
+
+// Mark p RUNNABLE and queue it on its cpu.  An EDF process
+// that has used up its budget waits for its next release
+// (see edfrelease).  p->lock must be held.
+static void
+setrunnable(struct proc *p)
+{
+  p->state = RUNNABLE;
+  if(!p->edfthrottled)
+    runqadd(&cpus[p->cpuNum].rq, p);
+}
+
+// Change p's priority, moving it to the right run queue
+// level if it is waiting to run.  p->lock must be held.
+static void
+setpriority(struct proc *p, int priority)
+{
+  struct runq *rq;
+
+  rq = runqdel(p);
+  p->priority = priority;
+  if(rq)
+    runqadd(rq, p);
+}
+
+//PAGEBREAK: 30
+// Timed priority windows.  setTime() arms three timers per
+// process; they fire from the timer interrupt (see timerfire)
+// and each touches only its own process.  Windows repeat daily.
+
+#define DAYTICKS (24*60*60*HZ)
+
+// Arm t for the next local hour:min; times past 24:00 mean never.
+static void
+armwindow(struct timer *t, int hour, int min)
+{
+  if(hour < 0 || min < 0 || hour*60 + min > 24*60)
+    timerdel(t);
+  else
+    timerset(t, localtick(hour, min));
+}
+
+// Arm the deadline timer t for hour:min today.  A deadline
+// that has already passed fires on the next tick rather than
+// tomorrow.  The new deadline has not been missed yet, whatever
+// became of the old one.  t->proc->lock must be held.
+static void
+armdeadline(struct timer *t, int hour, int min)
+{
+  t->proc->overDeadline = 0;
+  if(hour < 0 || min < 0 || hour*60 + min > 24*60)
+    timerdel(t);
+  else
+    timerset(t, localtoday(hour, min));
+}
+
+static void
+winstart(struct timer *t, uint gen)
+{
+  struct proc *p = t->proc;
+  int temp;
+
+  acquire(&p->lock);
+  if(t->gen == gen){
+    if(p->inTime == 0){
+      temp = p->priority;
+      setpriority(p, p->timePriority);
+      p->timePriority = temp;
+      p->inTime = 1;
+    }
+    timerset(t, t->when + DAYTICKS);
+  }
+  release(&p->lock);
+}
+
+static void
+winend(struct timer *t, uint gen)
+{
+  struct proc *p = t->proc;
+  int temp;
+
+  acquire(&p->lock);
+  if(t->gen == gen){
+    if(p->inTime == 1){
+      temp = p->timePriority;
+      p->timePriority = p->priority;
+      setpriority(p, p->overDeadline ? 2 : temp);
+      p->inTime = 0;
+    }
+    timerset(t, t->when + DAYTICKS);
+  }
+  release(&p->lock);
+}
+
+static void
+deadlinehit(struct timer *t, uint gen)
+{
+  struct proc *p = t->proc;
+
+  acquire(&p->lock);
+  if(t->gen == gen){
+    p->overDeadline = 1;
+    if(p->inTime == 0)
+      setpriority(p, 2);
+  }
+  release(&p->lock);
+}
+
+//PAGEBREAK: 40
+// Earliest-deadline-first class.  An EDF process is promised
+// edfbudget ticks of cpu in every edfperiod ticks, finished by
+// the end of the period.  setEdf() binds it to one cpu and
+// admits it only if that cpu's total EDF load, the sum of
+// budget/period, stays within EDFMAXUTIL percent; on a single
+// cpu that is enough for EDF to meet every deadline.  Each
+// period begins with a release that refills the budget and
+// moves the deadline on; a process that has used its budget
+// before then is throttled, so it cannot starve the cpu.
+
+static int
+edfload(int budget, int period)
+{
+  return (budget*1000 + period - 1) / period;
+}
+
+// Return p to the priority class.  p->lock must be held.
+static void
+edfleave(struct proc *p)
+{
+  struct runq *rq;
+
+  if(!p->edf)
+    return;
+  acquire(&edf.lock);
+  edf.util[p->cpuNum] -= edfload(p->edfbudget, p->edfperiod);
+  release(&edf.lock);
+  timerdel(&p->edftimer);
+  rq = runqdel(p);
+  p->edf = 0;
+  if(rq || (p->edfthrottled && p->state == RUNNABLE))
+    runqadd(&cpus[p->cpuNum].rq, p);
+  p->edfthrottled = 0;
+}
+
+static void
+edfrelease(struct timer *t, uint gen)
+{
+  struct proc *p = t->proc;
+  struct runq *rq;
+
+  acquire(&p->lock);
+  if(t->gen == gen && p->edf){
+    rq = runqdel(p);
+    p->edfused = 0;
+    p->edfdeadline = t->when + p->edfperiod;
+    timerset(t, p->edfdeadline);
+    if(rq || (p->edfthrottled && p->state == RUNNABLE))
+      runqadd(&cpus[p->cpuNum].rq, p);
+    p->edfthrottled = 0;
+  }
+  release(&p->lock);
+}
+
+// Charge the process running on this cpu for one clock tick,
+// which interrupted it in user mode if user is set.  Only this
+// cpu writes p->ru while p runs, so it needs no lock.
+void
+schedtick(int user)
+{
+  struct proc *p = myproc();
+
+  if(p == 0)
+    return;
+  if(user)
+    p->ru.utime++;
+  else
+    p->ru.stime++;
+  if(!p->edf)
+    return;
+  acquire(&p->lock);
+  if(p->edf && ++p->edfused >= p->edfbudget)
+    p->edfthrottled = 1;
+  release(&p->lock);
 }
 
 // Must be called with interrupts disabled
@@ -82,14 +498,18 @@ allocproc(void)
   int runnableNum = 3;
   acquire(&ptable.lock);
 
+  // Only a hint for the default priority, so no p->lock.
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->state == RUNNABLE || p->state == RUNNING)
 	runnableNum++;
   }
   //cprintf("\n");
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    acquire(&p->lock);
     if(p->state == UNUSED)
       goto found;
+    release(&p->lock);
+  }
 
   release(&ptable.lock);
   return 0;
@@ -107,6 +527,9 @@ found:
   p->startTime[1] = 60;
   p->endTime[0] = 24;
   p->endTime[1] = 60;
+  p->edf = 0;
+  p->edfthrottled = 0;
+  memset(&p->ru, 0, sizeof(p->ru));
   if(runnableNum > 20)
 	p->priority = 20;
   else if(runnableNum < 3)
@@ -115,6 +538,7 @@ found:
 	p->priority = runnableNum;
   
   //cprintf("%d-%d\n", p->pid, p->priority);
+  release(&p->lock);
   release(&ptable.lock);
  
 	
@@ -168,20 +592,25 @@ userinit(void)
   p->tf->eip = 0;  // beginning of initcode.S
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
+  p->basepriority = 1;
+  p->nice = 0;
+  p->schedflags = 0;
   p->cwd = namei("/");
 
   // this assignment to p->state lets other cores
   // run this process. the acquire forces the above
   // writes to be visible, and the lock is also needed
   // because the assignment might not be atomic.
-  acquire(&ptable.lock);
+  acquire(&p->lock);
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
-  release(&ptable.lock);
+  release(&p->lock);
 }
 
 // Grow current process's memory by n bytes.
+// Growth is lazy: the pages are allocated when first
+// touched (see lazyfault).
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
@@ -191,8 +620,9 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if(sz + n < sz || sz + n > mmapbase(curproc))
       return -1;
+    sz += n;
   } else if(n < 0){
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
@@ -218,14 +648,13 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz, curproc->vma)) == 0){
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
     return -1;
   }
   np->sz = curproc->sz;
-  np->parent = curproc;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
@@ -235,16 +664,30 @@ fork(void)
     if(curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
+  vmadup(np->vma, curproc->vma);
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
+  // The child keeps its parent's policy, less the exec boost.
+  np->basepriority = curproc->basepriority;
+  np->nice = curproc->nice;
+  np->schedflags = curproc->schedflags & ~SCHED_INTERACTIVE;
+
   pid = np->pid;
 
   acquire(&ptable.lock);
+  np->parent = curproc;
+  release(&ptable.lock);
 
-  np->state = RUNNABLE;
+  acquire(&np->lock);
+  np->cpuNum = idlestcpu();
+  setrunnable(np);
+  release(&np->lock);
 
-  release(&ptable.lock);
+  // An EDF parent's child asks for the same reservation, and
+  // stays in the priority class if it does not fit.
+  if(curproc->edf)
+    setEdf(pid, curproc->edfbudget, curproc->edfperiod);
 
   return pid;
 }
@@ -270,37 +713,115 @@ exit(void)
     }
   }
 
+  vmaflush(curproc->pgdir, curproc->vma);
   begin_op();
   iput(curproc->cwd);
+  vmafree(curproc->vma);
   end_op();
   curproc->cwd = 0;
 
   acquire(&ptable.lock);
 
-  // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
-
   // Pass abandoned children to init.
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->parent == curproc){
       p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
+      wakeup(initproc);
     }
   }
 
+  // Parent might be sleeping in wait().
+  wakeup(curproc->parent);
+
   // Jump into the scheduler, never to return.
+  // wait() cannot see ZOMBIE until sched() has
+  // switched away and the scheduler drops p->lock.
+  acquire(&curproc->lock);
+  edfleave(curproc);
   curproc->state = ZOMBIE;
+  release(&ptable.lock);
   sched();
   panic("zombie exit");
 }
 
+//PAGEBREAK: 30
+// Exit log.  wait() appends a record of each reaped child to a
+// ring that exitinfo() reads, rather than printing to the
+// console.  Writers claim a slot with an atomic add and never
+// block; a record's seq is zeroed while it is being written, so
+// readers can skip records that change under them.
+
+static struct {
+  uint next;                     // Number of records ever claimed
+  struct exitinfo rec[NEXITLOG];
+} exits;
+
+static void
+exitlog(struct exitinfo *e)
+{
+  struct exitinfo *r;
+  uint n;
+
+  n = xadd(&exits.next, 1);
+  r = &exits.rec[n % NEXITLOG];
+  r->seq = 0;
+  __sync_synchronize();
+  e->seq = 0;
+  e->when = ticks;
+  *r = *e;
+  __sync_synchronize();
+  r->seq = n + 1;
+  if(EXITDEBUG){
+    cprintf("---------------\n");
+    cprintf("pid: %d\nCPU ticks: %d\nMemory: %d\n", e->pid, e->ticks, e->sz);
+    cprintf("---------------\n");
+  }
+}
+
+// Copy up to n of the most recent exit records, oldest first,
+// to buf and return how many were copied.
+int
+exitinfo(struct exitinfo *buf, int n)
+{
+  struct exitinfo e;
+  volatile struct exitinfo *r;
+  uint end, s;
+  int i;
+
+  end = exits.next;
+  s = end > NEXITLOG ? end - NEXITLOG : 0;
+  if(end - s > n)
+    s = end - n;
+  for(i = 0; s < end; s++){
+    r = &exits.rec[s % NEXITLOG];
+    if(r->seq != s + 1)
+      continue;
+    __sync_synchronize();
+    e = *(struct exitinfo*)r;
+    __sync_synchronize();
+    if(r->seq != s + 1 || e.seq != s + 1)
+      continue;
+    buf[i++] = e;
+  }
+  return i;
+}
+
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
 int
 wait(void)
+{
+  return wait2(0);
+}
+
+// Like wait, but also copy the child's resource usage to *ru
+// if ru is not 0.
+int
+wait2(struct rusage *ru)
 {
   struct proc *p;
+  struct rusage r;
+  struct exitinfo e;
   int havekids, pid;
   struct proc *curproc = myproc();
   
@@ -312,13 +833,17 @@ wait(void)
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
       if(p->parent != curproc)
         continue;
+      acquire(&p->lock);
       havekids = 1;
       if(p->state == ZOMBIE){
         // Found one.
-	cprintf("---------------\n");
-	cprintf("pid: %d\nCPU ticks: %d\nMemory: %d\n",p->pid, p->curalarmticks, p->sz);
-	cprintf("---------------\n");
         pid = p->pid;
+        r = p->ru;
+        e.pid = pid;
+        e.ticks = r.utime + r.stime;
+        e.wtime = r.wtime;
+        e.sz = p->sz;
+        memmove(e.name, p->name, sizeof(e.name));
         kfree(p->kstack);
         p->kstack = 0;
         freevm(p->pgdir);
@@ -327,9 +852,18 @@ wait(void)
         p->name[0] = 0;
         p->killed = 0;
         p->state = UNUSED;
+        timerdel(&p->starttimer);
+        timerdel(&p->endtimer);
+        timerdel(&p->deadlinetimer);
+        timerdel(&p->edftimer);
+        release(&p->lock);
         release(&ptable.lock);
+        exitlog(&e);
+        if(ru)
+          *ru = r;
         return pid;
       }
+      release(&p->lock);
     }
 
     // No point waiting if we don't have any children.
@@ -338,7 +872,7 @@ wait(void)
       return -1;
     }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
+    // Wait for children to exit.  (See wakeup call in proc_exit.)
     sleep(curproc, &ptable.lock);  //DOC: wait-sleep
   }
 }
@@ -357,142 +891,43 @@ void
 scheduler(void)
 {
   struct proc *p;
-
-  //get time
-  struct rtcdate r;
-  cmostime(&r);
-  int hour = r.hour + 8, min = r.minute, totalMin;
-  int temp;
-  //static int check = 0;
   struct cpu *c = mycpu();
   c->proc = 0;
 
   for(;;){
-   // Enable interrupts on this processor.
+    // Enable interrupts on this processor.
     sti();
-     //
-   // struct proc *highP=NULL;
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);  //pic
-    
-    for(p=ptable.proc;p<&ptable.proc[NPROC];p++){
-	if(p->name[0] == 's' && p->name[1] == 'h')
-	  { p->priority = 1;}
-	if(p->name[0] == 'p' && p->name[1] == 't')
-	  {p->priority = 1;}
-    }
 
-	//int closest = 1440;
-	//int closestPid = 0;
-
-    /* check priority per minute */
-    cmostime(&r);//pic
-    if((min != r.minute))
-    {
-	//cprintf("Check time per minutes\n");	
-	min = r.minute;
-	hour = r.hour + 8;
-        for(p=ptable.proc;p<&ptable.proc[NPROC];p++)
-	{	
-	    /* check if prority is in time or not*/
-	    if(p->startTime[0] == hour && p->startTime[1] == min && p->inTime == 0){
-	        //cprintf("now1: %d-%d\n", p->priority, p->timePriority);
-	    	temp = p->priority;
-	        p->priority = p->timePriority;
- 	        p->timePriority = temp; 
-		p->inTime = 1;
-                //cprintf("changed1: %d-%d\n", p->priority, p->timePriority);
-            }
-		//cprintf("%d\n", c->cpuNum);
-		//cprintf("--%d--\n", nowCPU);
-	    if(p->endTime[0] == hour && p->endTime[1] == min && p->inTime == 1){	
-		//cprintf("now2: %d-%d\n", p->priority, p->timePriority);	        
-		temp = p->timePriority;
-	        p->timePriority = p->priority;
- 	        p->priority = temp;
-		p->inTime = 0;
-	        //cprintf("changed2: %d-%d\n", p->priority, p->timePriority);
-            }
-	    /* check deadline if process is over deadline or not*/
-	    
-	    totalMin = (p->deadline[0] - hour) * 60 + (p->deadline[1] - min);
-	    if(p->inTime == 0 && totalMin <= 0)
-		{p->priority = 2; p->overDeadline = 1;}
-	    else{
-		p->overDeadline = 0;
-		//if(closest > totalMin)
-		    //{closest = totalMin; closestPid = p->pid;}
-		}
-        }
+    /* run the process with the highest priority, earliest deadline */
+    if((p = runqpop(&c->rq, 1)) == 0 && (p = steal(c)) == 0){
+      kzerofill();
+      continue;
     }
-/*
-	//if(check == 0){
-	    for(p=ptable.proc;p<&ptable.proc[NPROC];p++){
-	        if(p->state == RUNNABLE && p->pid == closestPid && p->priority != 3)
-	   	    p->priority = 3;
-	        else{
-		    if(p->state == RUNNABLE || p->state == RUNNING)
-		    p->priority++;
-	       	    }		
-	        }
-            }
-	    //check = 1;
-        //}
-	//else
-	    //check = 0;
-
-*/
-
-
-
-	/* find process with hightest priority */
-	int highestPid = 0;
-	int highestPri = 20;
-	int deadline = 1440;
-	for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-	    if(p->state == RUNNABLE && (p->priority < highestPri)){
-		highestPid = p->pid;
-		highestPri = p->priority;
-		deadline = (p->deadline[0] - hour) * 60 + (p->deadline[1] - min);
-	    }
-	    /* check which deadline is closer */
-	    else if(p->state == RUNNABLE && (p->priority == highestPri)){
-		int pDeadline = (p->deadline[0] - hour) * 60 + (p->deadline[1] - min);
-		if(pDeadline < deadline){		
-		    highestPid = p->pid;
-		    highestPri = p->priority;
-		    deadline = pDeadline;
-		}
-	    }
-	}
-
-      for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-       if(p->state != RUNNABLE)
-        continue;
-       if(p->pid != highestPid)
-	continue;
 
+    acquire(&p->lock);
+    if(p->state == RUNNABLE){
       // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
+      // to release p->lock and then reacquire it
       // before jumping back to us.
       c->proc = p;
-      switchuvm(p);//pic
+      switchuvm(p);
       p->state = RUNNING;
-      p->cpuNum = c->cpuNum;
+      p->ru.wtime += ticks - p->rqstamp;
+      if(!p->edf)
+        p->cpuNum = c->cpuNum;
 
-      swtch(&(c->scheduler), p->context);//pic
-      switchkvm();//pic
+      swtch(&(c->scheduler), p->context);
+      switchkvm();
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
       c->proc = 0;
     }
-    release(&ptable.lock);//pic
-
+    release(&p->lock);
   }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
+// Enter scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
@@ -505,14 +940,18 @@ sched(void)
   int intena;
   struct proc *p = myproc();
 
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if(!holding(&p->lock))
+    panic("sched p->lock");
   if(mycpu()->ncli != 1)
     panic("sched locks");
   if(p->state == RUNNING)
     panic("sched running");
   if(readeflags()&FL_IF)
     panic("sched interruptible");
+  if(p->state == RUNNABLE)
+    p->ru.nivcsw++;
+  else if(p->state == SLEEPING)
+    p->ru.nvcsw++;
   intena = mycpu()->intena;
   swtch(&p->context, mycpu()->scheduler);
   mycpu()->intena = intena;
@@ -522,10 +961,12 @@ sched(void)
 void
 yield(void)
 {
-  acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  struct proc *p = myproc();
+
+  acquire(&p->lock);  //DOC: yieldlock
+  setrunnable(p);
   sched();
-  release(&ptable.lock);
+  release(&p->lock);
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -534,8 +975,8 @@ void
 forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -562,16 +1003,15 @@ sleep(void *chan, struct spinlock *lk)
   if(lk == 0)
     panic("sleep without lk");
 
-  // Must acquire ptable.lock in order to
+  // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
+  // Once we hold p->lock, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
+  // (wakeup locks p->lock),
   // so it's okay to release lk.
-  if(lk != &ptable.lock){  //DOC: sleeplock0
-    acquire(&ptable.lock);  //DOC: sleeplock1
-    release(lk);
-  }
+  acquire(&p->lock);  //DOC: sleeplock1
+  release(lk);
+
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
@@ -582,32 +1022,26 @@ sleep(void *chan, struct spinlock *lk)
   p->chan = 0;
 
   // Reacquire original lock.
-  if(lk != &ptable.lock){  //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+  release(&p->lock);
+  acquire(lk);
 }
 
 //PAGEBREAK!
 // Wake up all processes sleeping on chan.
-// The ptable lock must be held.
-static void
-wakeup1(void *chan)
-{
-  struct proc *p;
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
-}
-
-// Wake up all processes sleeping on chan.
+// Must be called without any p->lock.
 void
 wakeup(void *chan)
 {
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+  struct proc *p, *curproc = myproc();
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p == curproc)
+      continue;
+    acquire(&p->lock);
+    if(p->state == SLEEPING && p->chan == chan)
+      setrunnable(p);
+    release(&p->lock);
+  }
 }
 
 // Kill the process with the given pid.
@@ -618,18 +1052,18 @@ kill(int pid)
 {
   struct proc *p;
 
-  acquire(&ptable.lock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    acquire(&p->lock);
     if(p->pid == pid){
       p->killed = 1;
       // Wake process from sleep if necessary.
       if(p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
+        setrunnable(p);
+      release(&p->lock);
       return 0;
     }
+    release(&p->lock);
   }
-  release(&ptable.lock);
   return -1;
 }
 
@@ -672,31 +1106,33 @@ procdump(void)
 int
 cps()
 {
-  struct proc *p;
+  struct proc *p, snap;
   
   // Enable interrupts on this processor.
   sti();
 
     // Loop over process table looking for process with pid.
-  acquire(&ptable.lock);
   cprintf("------------------------------------------------------------------------------------------------------------------\n");
   cprintf("name \t pid \t state \t \t priority \t startTime \t endTime \t deadline \t CPU ticks \t memory\n");
   for(p=ptable.proc;p<&ptable.proc[NPROC];p++){
-      if(p->state == SLEEPING)
+      // Print from a copy: cprintf must not run under p->lock,
+      // since consoleintr() calls wakeup() with cons.lock held.
+      acquire(&p->lock);
+      snap = *p;
+      release(&p->lock);
+      if(snap.state == SLEEPING)
         cprintf("%s\t %d  \t SLEEPING \t %d \t\t\t\t\t\t\t\t\t\t %d\n"
-	,p->name,p->pid,p->priority, p->sz);
-      else if(p->state == RUNNING)
+	,snap.name,snap.pid,snap.priority, snap.sz);
+      else if(snap.state == RUNNING)
 	cprintf("%s\t %d  \t RUNNING \t %d \t\t %d:%d \t\t %d:%d \t\t %d:%d \t\t %d \t\t %d\n"
-	,p->name,p->pid,p->priority, p->startTime[0], p->startTime[1], p->endTime[0], p->endTime[1], p->deadline[0], p->deadline[1], p->curalarmticks, p->sz);
-      else if(p->state == RUNNABLE)
+	,snap.name,snap.pid,snap.priority, snap.startTime[0], snap.startTime[1], snap.endTime[0], snap.endTime[1], snap.deadline[0], snap.deadline[1], snap.ru.utime + snap.ru.stime, snap.sz);
+      else if(snap.state == RUNNABLE)
 	cprintf("%s\t %d  \t RUNNABLE \t %d \t\t %d:%d \t\t %d:%d \t\t %d:%d \t\t %d \t\t %d\n"
-	,p->name,p->pid,p->priority, p->startTime[0], p->startTime[1], p->endTime[0], p->endTime[1], p->deadline[0], p->deadline[1], p->curalarmticks, p->sz);
+	,snap.name,snap.pid,snap.priority, snap.startTime[0], snap.startTime[1], snap.endTime[0], snap.endTime[1], snap.deadline[0], snap.deadline[1], snap.ru.utime + snap.ru.stime, snap.sz);
   }
   cprintf("------------------------------------------------------------------------------------------------------------------\n");  
   
 
-  release(&ptable.lock);
-
   return 22;
 
 }
@@ -706,18 +1142,21 @@ int
 chpr(int pid,int priority)
 {
   struct proc *p;
+  int intime;
 
-  acquire(&ptable.lock);
   for(p=ptable.proc;p<&ptable.proc[NPROC];p++){
+    acquire(&p->lock);
     if(p->pid == pid){
-	if(p->inTime == 1)
+	intime = p->inTime;
+	if(!intime)
+  	    setpriority(p, priority);
+        release(&p->lock);
+	if(intime)
 	    cprintf("Error, process is in setTime.\n");
-	else
-  	    p->priority = priority;
         break;
     }
+    release(&p->lock);
   }
-  release(&ptable.lock);
 
   return pid;
 }
@@ -726,21 +1165,29 @@ chpr(int pid,int priority)
 int setTime(int pid, int priority, int startHour, int startMin, int endHour, int endMin, int deadlineHour, int deadlineMin)
 {
   struct proc *p;
+  struct runq *rq;
 
-  acquire(&ptable.lock);
   for(p=ptable.proc;p<&ptable.proc[NPROC];p++){
+    acquire(&p->lock);
     if(p->pid == pid){
         p->startTime[0] = startHour;
 	p->startTime[1] = startMin;
 	p->endTime[0] = endHour;
 	p->endTime[1] = endMin;
+	p->timePriority = priority;
+	armwindow(&p->starttimer, startHour, startMin);
+	armwindow(&p->endtimer, endHour, endMin);
+	armdeadline(&p->deadlinetimer, deadlineHour, deadlineMin);
+	rq = runqdel(p);
 	p->deadline[0] = deadlineHour;
 	p->deadline[1] = deadlineMin;
-	p->timePriority = priority;
+	if(rq)
+	    runqadd(rq, p);
+        release(&p->lock);
         break;
     }
+    release(&p->lock);
   }
-  release(&ptable.lock);
   return pid;
 
 }
@@ -751,45 +1198,260 @@ int checkTime(int hour, int min)
   struct proc *p;
   int temp;
   /*??*/
-  acquire(&ptable.lock);
   for(p=ptable.proc;p<&ptable.proc[NPROC];p++){
     cprintf("%d--%d\n", p->pid, p->priority);
+    acquire(&p->lock);
     if(p->startTime[0] == hour && p->startTime[1] == min){
 	
 	    temp = p->priority;
-	    p->priority = p->timePriority;
+	    setpriority(p, p->timePriority);
  	    p->timePriority = temp; 
     }
     if(p->endTime[0] == hour && p->endTime[1] == min){
 	
 	    temp = p->timePriority;
 	    p->timePriority = p->priority;
- 	    p->priority = temp; 
+ 	    setpriority(p, temp); 
     }
+    release(&p->lock);
   }
     cprintf("%d\n");
-  release(&ptable.lock);
   return 0;
 }
 
+// Nothing to do: run queues age as they are served (see
+// runqlevel).  Kept for programs that still call it.
 int checkPr(void){
 
-struct proc *p;
-  
-  // Enable interrupts on this processor.
-  sti();
+  return 0;
+}
 
-    // Loop over process table looking for process with pid.
-  acquire(&ptable.lock);
 
-  for(p=ptable.proc;p<&ptable.proc[NPROC];p++){
-    if((p->state == RUNNABLE || p->state == RUNNING) && p->inTime == 0 && p->overDeadline == 0 && p->priority > 3)
-	p->priority--;
+// Put pid in the EDF class with the given budget and period,
+// in ticks, or return it to the priority class if budget is 0.
+// Returns -1 if there is no such process or no cpu has room
+// for the load, in which case pid keeps its old class.
+int
+setEdf(int pid, int budget, int period)
+{
+  struct proc *p;
+  struct runq *rq;
+  int c, best, bestfree, load, free;
+
+  if(budget < 0 || period <= 0 || budget > period)
+    return -1;
+  load = edfload(budget, period);
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid != pid || p->state == UNUSED || p->state == ZOMBIE){
+      release(&p->lock);
+      continue;
+    }
+    if(budget == 0){
+      edfleave(p);
+      release(&p->lock);
+      return 0;
+    }
+
+    // Worst fit: the cpu with the most room left, counting the
+    // load p already holds there as free.
+    acquire(&edf.lock);
+    best = -1;
+    bestfree = 0;
+    for(c = 0; c < ncpu; c++){
+      free = EDFMAXUTIL*10 - edf.util[c];
+      if(p->edf && p->cpuNum == c)
+        free += edfload(p->edfbudget, p->edfperiod);
+      if(free >= load && (best < 0 || free > bestfree)){
+        best = c;
+        bestfree = free;
+      }
+    }
+    if(best < 0){
+      release(&edf.lock);
+      release(&p->lock);
+      return -1;
+    }
+    if(p->edf)
+      edf.util[p->cpuNum] -= edfload(p->edfbudget, p->edfperiod);
+    edf.util[best] += load;
+    release(&edf.lock);
+
+    rq = runqdel(p);
+    if(!rq && p->edfthrottled && p->state == RUNNABLE)
+      rq = &cpus[best].rq;
+    p->edf = 1;
+    p->edfbudget = budget;
+    p->edfperiod = period;
+    p->edfused = 0;
+    p->edfthrottled = 0;
+    p->edfdeadline = ticks + period;
+    p->cpuNum = best;
+    timerset(&p->edftimer, p->edfdeadline);
+    if(rq)
+      runqadd(&cpus[best].rq, p);
+    release(&p->lock);
+    return 0;
   }
-  release(&ptable.lock);
+  return -1;
+}
 
+//PAGEBREAK: 30
+// Scheduling policy.  A process's policy (struct schedattr) is
+// inherited by fork and kept across exec, which resets the
+// process to its base priority plus nice.  Interactive
+// processes, such as the shell init starts, are boosted to
+// priority 1 then, once, instead of on every scheduling pass.
+// That was the old boost for the shell; level 0 stays for
+// processes given it explicitly.
+
+static int
+nicepriority(int basepriority, int nice)
+{
+  int pr;
+
+  pr = basepriority + nice;
+  if(pr < 0)
+    return 0;
+  if(pr >= NPRIO)
+    return NPRIO-1;
+  return pr;
+}
+
+// Apply p's policy to the image exec has just loaded.
+void
+schedexec(struct proc *p)
+{
+  acquire(&p->lock);
+  if(p->schedflags & SCHED_INTERACTIVE)
+    setpriority(p, 1);
+  else
+    setpriority(p, nicepriority(p->basepriority, p->nice));
+  release(&p->lock);
+}
+
+// Look up pid, or the caller if pid is 0, and return it locked.
+static struct proc*
+lockpid(int pid)
+{
+  struct proc *p;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED && p->state != ZOMBIE)
+      return p;
+    release(&p->lock);
+  }
   return 0;
+}
 
+// Set the scheduling policy of pid, or of the caller if pid
+// is 0.  The new priority takes effect at once.
+int
+setSched(int pid, struct schedattr *a)
+{
+  struct proc *p;
+
+  if(a->policy != SCHED_NORMAL && a->policy != SCHED_EDF)
+    return -1;
+  if(a->flags & ~SCHED_INTERACTIVE)
+    return -1;
+  if(a->priority < 0 || a->priority >= NPRIO)
+    return -1;
+  if(a->nice < -20 || a->nice > 20)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+
+  // Join or leave the EDF class first: admission may fail.
+  if(a->policy == SCHED_EDF){
+    if(a->budget <= 0 || setEdf(pid, a->budget, a->period) < 0)
+      return -1;
+  } else if(setEdf(pid, 0, 1) < 0)
+    return -1;
+
+  if((p = lockpid(pid)) == 0)
+    return -1;
+  p->basepriority = a->priority;
+  p->nice = a->nice;
+  p->schedflags = a->flags;
+  if(!p->edf)
+    setpriority(p, nicepriority(p->basepriority, p->nice));
+  release(&p->lock);
+  return 0;
+}
+
+// Return the scheduling policy of pid, or of the caller if
+// pid is 0.
+int
+getSched(int pid, struct schedattr *a)
+{
+  struct proc *p;
+
+  if((p = lockpid(pid)) == 0)
+    return -1;
+  a->policy = p->edf ? SCHED_EDF : SCHED_NORMAL;
+  a->flags = p->schedflags;
+  a->priority = p->basepriority;
+  a->nice = p->nice;
+  a->budget = p->edf ? p->edfbudget : 0;
+  a->period = p->edf ? p->edfperiod : 0;
+  release(&p->lock);
+  return 0;
+}
 
+// Copy the resource usage of pid, or of the caller if pid is
+// 0, to *ru.
+int
+getrusage(int pid, struct rusage *ru)
+{
+  struct proc *p;
+  struct rusage r;
+
+  if((p = lockpid(pid)) == 0)
+    return -1;
+  r = p->ru;
+  release(&p->lock);
+  *ru = r;
+  return 0;
 }
 
+// Copy a record for each of up to n processes to buf and
+// return how many were copied.  Each p->lock is held only to
+// copy out the fields.
+int
+procinfo(struct procinfo *buf, int n)
+{
+  struct proc *p;
+  struct procinfo pi;
+  int i;
+
+  i = 0;
+  for(p = ptable.proc; p < &ptable.proc[NPROC] && i < n; p++){
+    acquire(&p->lock);
+    if(p->state == UNUSED){
+      release(&p->lock);
+      continue;
+    }
+    pi.pid = p->pid;
+    pi.state = p->state;
+    pi.priority = p->priority;
+    pi.edf = p->edf;
+    pi.startTime[0] = p->startTime[0];
+    pi.startTime[1] = p->startTime[1];
+    pi.endTime[0] = p->endTime[0];
+    pi.endTime[1] = p->endTime[1];
+    pi.deadline[0] = p->deadline[0];
+    pi.deadline[1] = p->deadline[1];
+    pi.ticks = p->ru.utime + p->ru.stime;
+    pi.sz = p->sz;
+    pi.cpu = p->cpuNum;
+    memmove(pi.name, p->name, sizeof(pi.name));
+    release(&p->lock);
+    buf[i++] = pi;
+  }
+  return i;
+}
@@ -1,3 +1,15 @@
+// Per-CPU run queue.  One list of RUNNABLE processes per
+// priority level, each sorted by deadline, plus a bitmap of the
+// non-empty levels.  Lock order: p->lock, then rq.lock.
+struct runq {
+  struct spinlock lock;
+  struct proc *edf;            // EDF processes, earliest deadline first
+  struct proc *head[NPRIO];    // Lowest value is highest priority
+  uint ready;                  // Bit i is set iff head[i] is non-empty
+  uint stamp[NPRIO];           // Tick level i was last served or filled
+  int n;                       // Number of queued processes
+};
+
 // Per-CPU state
 struct cpu {
   uchar apicid;                // Local APIC ID
@@ -8,7 +20,8 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
-  int cpuNum;
+  int cpuNum;                  // Index in cpus[]
+  struct runq rq;              // Processes waiting to run on this cpu
 };
 
 extern struct cpu cpus[NCPU];
@@ -35,8 +48,39 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// One-shot kernel timer, kept on a min-heap in timer.c and fired
+// from the timer interrupt.  fn is called without locks held;
+// gen is t->gen at the time t fired, so fn can tell (under its
+// own lock) whether t was re-armed or cancelled in the meantime.
+struct timer {
+  uint when;                   // Value of ticks at which to fire
+  int idx;                     // Index in the timer heap, or -1
+  uint gen;                    // Bumped by every timerset/timerdel
+  void (*fn)(struct timer*, uint);
+  struct proc *proc;           // Process the timer belongs to
+};
+
+// A region of user memory whose pages are filled in when first
+// touched (see lazyfault), from a file or with zeros.
+struct vma {
+  int flags;             // VMA_USED, or 0 if the slot is free
+  uint start;            // First address, page aligned
+  uint end;              // Address after the last, page aligned
+  struct inode *ip;      // File the pages come from, or 0
+  uint off;              // Offset in ip of start
+  uint filesz;           // Bytes of file data from start; the rest is zero
+  int perm;              // PTE_W if writable, else 0
+  struct shm *shm;       // Shared memory segment mapped, or 0
+};
+
+#define VMA_USED   0x1
+#define VMA_MMAP   0x2   // Made by mmap(), above p->sz
+#define VMA_SHARED 0x4   // Pages are not copied on fork; see mmap
+#define VMA_EXEC   0x8   // Loaded by exec; ip refuses writes (idenywrite)
+
 // Per-process state
 struct proc {
+  struct spinlock lock;        // Protects state, chan, killed, run queue links
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
   char *kstack;                // Bottom of kernel stack for this process
@@ -49,18 +93,37 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct vma vma[NVMA];        // Demand-paged regions of memory
   char name[16];               // Process name (debugging)
   int priority;		       // Process priority (0-20); lower value,higher priority
+  int basepriority;            // Policy: priority set at exec; see sched.h
+  int nice;                    // Policy: added to basepriority
+  int schedflags;              // Policy: SCHED_INTERACTIVE
+  uint rqstamp;                // Tick p was last queued, for ru.wtime
+  struct rusage ru;            // Resource usage; see getrusage
   int alarmticks;	       // Process alarm
-  int curalarmticks;
+  int curalarmticks;           // Ticks in user mode since the last alarm
   void (*alarmhandler)();
   int startTime[2];
   int endTime[2];
   int deadline[2];
   int timePriority;
-  int cpuNum;
+  int cpuNum;                  // Affinity: cpu whose run queue p joins
   int inTime;
   int overDeadline;
+  struct timer starttimer;     // Fires at startTime: raise to timePriority
+  struct timer endtimer;       // Fires at endTime: drop back
+  struct timer deadlinetimer;  // Fires at deadline
+  int edf;                     // If non-zero, in the EDF class; see setEdf
+  uint edfbudget;              // EDF: ticks of cpu guaranteed per period
+  uint edfperiod;              // EDF: period and relative deadline, in ticks
+  uint edfdeadline;            // EDF: absolute deadline of this period
+  uint edfused;                // EDF: ticks run in this period
+  int edfthrottled;            // EDF: budget used up; wait for release
+  struct timer edftimer;       // EDF: fires at the next period release
+  struct proc *rqnext;         // Next RUNNABLE process on the same run queue
+  struct runq *rq;             // Run queue p is linked on, or 0
+  int level;                   // Run queue level: priority when queued
 
 };
 
@@ -0,0 +1,26 @@
+// Process table snapshot, for procinfo().
+// state is an enum procstate: 2 SLEEPING, 3 RUNNABLE, 4 RUNNING, 5 ZOMBIE.
+struct procinfo {
+  int pid;
+  int state;
+  int priority;     // 0-20; lower value, higher priority
+  int edf;          // In the EDF class
+  int startTime[2]; // Window start, hour and minute
+  int endTime[2];   // Window end
+  int deadline[2];
+  uint ticks;       // Cpu ticks used, user and system
+  uint sz;          // Size of process memory (bytes)
+  int cpu;          // Cpu the process runs on or is queued for
+  char name[16];
+};
+
+// Record of a reaped process, for exitinfo().
+struct exitinfo {
+  uint seq;         // Exit number since boot, from 1
+  int pid;
+  uint ticks;       // Cpu ticks used, user and system
+  uint wtime;       // Ticks spent waiting to run
+  uint sz;          // Size of process memory (bytes)
+  uint when;        // Tick at which it was reaped
+  char name[16];
+};
@@ -2,11 +2,56 @@
 #include "stat.h"
 #include "user.h"
 #include "fcntl.h"
+#include "param.h"
+#include "procinfo.h"
+
+// Print the process table, or with an argument, reprint it
+// every that many ticks, like top.
+
+static char *states[] = {
+[2]  "SLEEPING",
+[3]  "RUNNABLE",
+[4]  "RUNNING ",
+[5]  "ZOMBIE  ",
+};
+
+struct procinfo pi[NPROC];
+
+void
+show(void)
+{
+  int i, n;
+  struct procinfo *p;
+
+  n = procinfo(pi, NPROC);
+  printf(1, "name \t pid \t state \t \t priority \t startTime \t endTime \t deadline \t CPU ticks \t memory \t cpu\n");
+  for(i = 0; i < n; i++){
+    p = &pi[i];
+    if(p->state < 2 || p->state > 5)
+      continue;
+    printf(1, "%s\t %d  \t %s \t %d%s \t\t %d:%d \t\t %d:%d \t\t %d:%d \t\t %d \t\t %d \t\t %d\n",
+      p->name, p->pid, states[p->state], p->priority, p->edf ? " edf" : "",
+      p->startTime[0], p->startTime[1], p->endTime[0], p->endTime[1],
+      p->deadline[0], p->deadline[1], p->ticks, p->sz, p->cpu);
+  }
+}
 
 int
 main(int argc,char *argv[])
 {
-  cps();
+  int interval;
 
-  exit();
+  if(argc < 2){
+    show();
+    exit();
+  }
+  interval = atoi(argv[1]);
+  if(interval <= 0){
+    printf(2, "Usage: ptable [ticks]\n");
+    exit();
+  }
+  for(;;){
+    show();
+    sleep(interval);
+  }
 }
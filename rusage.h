@@ -0,0 +1,9 @@
+// Per-process resource usage, for getrusage() and wait2().
+struct rusage {
+  uint utime;     // Clock ticks running in user mode
+  uint stime;     // Clock ticks running in the kernel
+  uint wtime;     // Clock ticks waiting on a run queue
+  uint nvcsw;     // Voluntary context switches (sleeps)
+  uint nivcsw;    // Involuntary context switches (preemptions)
+  uint pgfaults;  // Page faults
+};
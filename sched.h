@@ -0,0 +1,14 @@
+// Scheduling attributes, for setSched() and getSched().
+#define SCHED_NORMAL  0   // Priority levels 0-20, lower runs first
+#define SCHED_EDF     1   // Earliest deadline first; see setEdf
+
+#define SCHED_INTERACTIVE 0x1  // Start at priority 1 on exec; not inherited
+
+struct schedattr {
+  int policy;     // SCHED_NORMAL or SCHED_EDF
+  int flags;      // SCHED_INTERACTIVE
+  int priority;   // Base priority, applied at exec
+  int nice;       // Added to priority, -20 to 20
+  int budget;     // SCHED_EDF: ticks of cpu per period
+  int period;     // SCHED_EDF: period in ticks
+};
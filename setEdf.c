@@ -0,0 +1,25 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+int main(int argc,char *argv[])
+{
+  int pid, budget, period;
+
+  if(argc<4){
+      printf(2,"Usage: setEdf pid budget period\n");
+      exit();
+  }
+  pid = atoi(argv[1]);
+  budget = atoi(argv[2]);
+  period = atoi(argv[3]);
+  if(period <= 0 || budget > period){
+     printf(2,"Invalid budget/period (0 <= budget <= period, in ticks)!\n");
+     exit();
+  }
+  printf(1," pid=%d, budget=%d, period=%d\n", pid, budget, period);
+  if(setEdf(pid, budget, period) < 0)
+     printf(2,"setEdf: not admitted\n");
+  exit();
+}
@@ -0,0 +1,116 @@
+// Shared memory segments.
+//
+// A segment is a fixed set of zeroed physical pages that any
+// number of processes can map at once, so they can exchange
+// data without copying it through a pipe.  shmopen() finds the
+// segment with a given key, creating it if there is none, and
+// returns a file descriptor for it; mmap() of that descriptor
+// with MAP_SHARED maps the segment's own pages (see mmap).
+//
+// Each open file and each mapping region holds one reference
+// to the segment, so it survives fork and close and is freed
+// when the last process unmaps or exits.  A segment with key 0
+// is private: no other shmopen() finds it, and only children
+// forked after it was opened can share it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "shm.h"
+
+struct {
+  struct spinlock lock;
+  struct shm shm[NSHM];
+} shmtab;
+
+void
+shminit(void)
+{
+  initlock(&shmtab.lock, "shm");
+}
+
+// Free the pages of s and its slot.  shmtab.lock must be held.
+static void
+shmfree(struct shm *s)
+{
+  int i;
+
+  for(i = 0; i < s->npages; i++)
+    kfree(s->page[i]);
+  s->npages = 0;
+  s->ref = 0;
+}
+
+// Return the segment with key, with a new reference, creating
+// it with size bytes if there is none.  Returns 0 if size is
+// too big for an existing segment or for SHMPAGES, or if
+// memory or segment slots have run out.
+struct shm*
+shmopen(int key, uint size)
+{
+  struct shm *s, *free;
+  uint n;
+
+  n = PGROUNDUP(size) / PGSIZE;
+  if(size == 0 || n > SHMPAGES)
+    return 0;
+  acquire(&shmtab.lock);
+  free = 0;
+  for(s = shmtab.shm; s < &shmtab.shm[NSHM]; s++){
+    if(s->ref == 0){
+      if(free == 0)
+        free = s;
+      continue;
+    }
+    if(key != 0 && s->key == key){
+      if(n > s->npages){
+        release(&shmtab.lock);
+        return 0;
+      }
+      s->ref++;
+      release(&shmtab.lock);
+      return s;
+    }
+  }
+  if((s = free) == 0){
+    release(&shmtab.lock);
+    return 0;
+  }
+  s->key = key;
+  for(s->npages = 0; s->npages < n; s->npages++){
+    if((s->page[s->npages] = kzalloc()) == 0){
+      shmfree(s);
+      release(&shmtab.lock);
+      return 0;
+    }
+  }
+  s->ref = 1;
+  release(&shmtab.lock);
+  return s;
+}
+
+// Take another reference to s.
+void
+shmdup(struct shm *s)
+{
+  acquire(&shmtab.lock);
+  if(s->ref < 1)
+    panic("shmdup");
+  s->ref++;
+  release(&shmtab.lock);
+}
+
+// Drop a reference to s, freeing it if it was the last.
+// Pages still mapped keep their own references (see kref).
+void
+shmclose(struct shm *s)
+{
+  acquire(&shmtab.lock);
+  if(s->ref < 1)
+    panic("shmclose");
+  if(--s->ref == 0)
+    shmfree(s);
+  release(&shmtab.lock);
+}
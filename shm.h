@@ -0,0 +1,7 @@
+// Shared memory segment; see shm.c.
+struct shm {
+  int ref;                  // Open files and regions mapping it; 0 if free
+  int key;                  // Name given to shmopen(), or 0 if private
+  int npages;               // Size, in pages
+  char *page[SHMPAGES];     // The pages, owned by the segment
+};
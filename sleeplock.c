@@ -6,8 +6,9 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
 #include "sleeplock.h"
 
 void
@@ -3,6 +3,8 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
@@ -18,8 +20,12 @@ int
 fetchint(uint addr, int *ip)
 {
   struct proc *curproc = myproc();
+  uint lim;
 
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  lim = uvmlimit(curproc, addr);
+  if(lim == 0 || addr+4 < addr || addr+4 > lim)
+    return -1;
+  if(uvmprefault(curproc, addr, 4, 0) < 0)
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -34,11 +40,13 @@ fetchstr(uint addr, char **pp)
   char *s, *ep;
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz)
+  if((ep = (char*)uvmlimit(curproc, addr)) == 0)
     return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
+    if((s == *pp || (uint)s % PGSIZE == 0) &&
+       uvmprefault(curproc, (uint)s, 1, 0) < 0)
+      return -1;
     if(*s == 0)
       return s - *pp;
   }
@@ -52,23 +60,41 @@ argint(int n, int *ip)
   return fetchint((myproc()->tf->esp) + 4 + 4*n, ip);
 }
 
-// Fetch the nth word-sized system call argument as a pointer
-// to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
-int
-argptr(int n, char **pp, int size)
+static int
+argblock(int n, char **pp, int size, int write)
 {
   int i;
+  uint lim;
   struct proc *curproc = myproc();
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  lim = uvmlimit(curproc, i);
+  if(size < 0 || lim == 0 || (uint)i+size < (uint)i || (uint)i+size > lim)
+    return -1;
+  if(uvmprefault(curproc, i, size, write) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
 }
 
+// Fetch the nth word-sized system call argument as a pointer
+// to a block of memory of size bytes.  Check that the pointer
+// lies within the process address space.
+int
+argptr(int n, char **pp, int size)
+{
+  return argblock(n, pp, size, 0);
+}
+
+// Like argptr, for a block the system call will write to:
+// also check that it is writable.
+int
+argwptr(int n, char **pp, int size)
+{
+  return argblock(n, pp, size, 1);
+}
+
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
 // (There is no shared writable memory, so the string can't change
@@ -112,6 +138,16 @@ extern int sys_alarm(void);
 extern int sys_setTime(void);
 extern int sys_checkTime(void);
 extern int sys_checkPr(void);
+extern int sys_setEdf(void);
+extern int sys_setSched(void);
+extern int sys_getSched(void);
+extern int sys_getrusage(void);
+extern int sys_wait2(void);
+extern int sys_procinfo(void);
+extern int sys_exitinfo(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_shmopen(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -144,6 +180,16 @@ static int (*syscalls[])(void) = {
 [SYS_setTime] sys_setTime,
 [SYS_checkTime] sys_checkTime,
 [SYS_checkPr] sys_checkPr,
+[SYS_setEdf]  sys_setEdf,
+[SYS_setSched] sys_setSched,
+[SYS_getSched] sys_getSched,
+[SYS_getrusage] sys_getrusage,
+[SYS_wait2]   sys_wait2,
+[SYS_procinfo] sys_procinfo,
+[SYS_exitinfo] sys_exitinfo,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_shmopen] sys_shmopen,
 };
 
 void
@@ -29,3 +29,13 @@
 #define SYS_setTime 26
 #define SYS_checkTime 27 
 #define SYS_checkPr 28
+#define SYS_setEdf 29
+#define SYS_setSched 30
+#define SYS_getSched 31
+#define SYS_getrusage 32
+#define SYS_wait2  33
+#define SYS_procinfo 34
+#define SYS_exitinfo 35
+#define SYS_mmap   36
+#define SYS_munmap 37
+#define SYS_shmopen 38
@@ -2,9 +2,13 @@
 #include "x86.h"
 #include "defs.h"
 #include "date.h"
+#include "sched.h"
+#include "procinfo.h"
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 
 int
@@ -108,10 +112,10 @@ int sys_chpr(void)
 
 int sys_date(struct rtcdate *r)
 {
-    if(argptr(0, (void*)&r, sizeof(&r)) < 0)
+    if(argwptr(0, (void*)&r, sizeof(*r)) < 0)
 	return -1;
 
-    cmostime(r);
+    walltime(r);
     return 0;
 }
 
@@ -169,9 +173,106 @@ int sys_checkPr(void)
   return checkPr ();
 }
 
+int sys_setEdf(void)
+{
+  int pid, budget, period;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  if(argint(1, &budget) < 0)
+    return -1;
+  if(argint(2, &period) < 0)
+    return -1;
+  return setEdf(pid, budget, period);
+}
+
 
 
 
 
 
 
+
+int sys_setSched(void)
+{
+  int pid;
+  struct schedattr *attr;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  if(argptr(1, (void*)&attr, sizeof(*attr)) < 0)
+    return -1;
+  return setSched(pid, attr);
+}
+
+int sys_getSched(void)
+{
+  int pid;
+  struct schedattr *attr;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  if(argwptr(1, (void*)&attr, sizeof(*attr)) < 0)
+    return -1;
+  return getSched(pid, attr);
+}
+
+int sys_getrusage(void)
+{
+  int pid;
+  struct rusage *ru;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  if(argwptr(1, (void*)&ru, sizeof(*ru)) < 0)
+    return -1;
+  return getrusage(pid, ru);
+}
+
+int sys_wait2(void)
+{
+  struct rusage *ru;
+
+  if(argwptr(0, (void*)&ru, sizeof(*ru)) < 0)
+    return -1;
+  return wait2(ru);
+}
+
+int sys_procinfo(void)
+{
+  int n;
+  struct procinfo *buf;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NPROC)
+    n = NPROC;
+  if(argwptr(0, (void*)&buf, n*sizeof(*buf)) < 0)
+    return -1;
+  return procinfo(buf, n);
+}
+
+int sys_exitinfo(void)
+{
+  int n;
+  struct exitinfo *buf;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NEXITLOG)
+    n = NEXITLOG;
+  if(argwptr(0, (void*)&buf, n*sizeof(*buf)) < 0)
+    return -1;
+  return exitinfo(buf, n);
+}
+
+int sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  if(argint(1, &len) < 0)
+    return -1;
+  return munmap(addr, len);
+}
@@ -0,0 +1,249 @@
+// Kernel wall clock and timers.
+//
+// Reading the CMOS real-time clock takes a dozen slow port
+// round trips and may spin while the RTC updates, so it is done
+// once, at boot.  After that the time of day is the boot time
+// plus the number of timer interrupts since, so readers never
+// touch an I/O port.  The LAPIC timer is not calibrated (see
+// lapicinit); HZ is its rate under QEMU.
+//
+// Timers are struct timers embedded in the objects they act on,
+// kept on a binary min-heap ordered by expiry tick.  Arming or
+// cancelling one is O(log n), and each clock tick looks only at
+// the root of the heap.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
+#include "date.h"
+
+// Enough for every timer embedded in struct proc.
+#define NTIMER (4*NPROC)
+
+static uint bootsecs;   // Seconds since 2000-01-01 00:00:00 at boot
+static uint bootticks;  // Value of ticks when bootsecs was read
+
+static struct {
+  struct spinlock lock;
+  struct timer *heap[NTIMER];
+  int n;
+} tq;
+
+static uint mdays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+static int
+isleap(uint y)
+{
+  return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+static uint
+monthdays(uint y, uint m)
+{
+  return mdays[m-1] + (m == 2 && isleap(y));
+}
+
+static uint
+rtc2secs(struct rtcdate *r)
+{
+  uint days, y, m;
+
+  days = 0;
+  for(y = 2000; y < r->year; y++)
+    days += isleap(y) ? 366 : 365;
+  for(m = 1; m < r->month; m++)
+    days += monthdays(r->year, m);
+  days += r->day - 1;
+  return ((days*24 + r->hour)*60 + r->minute)*60 + r->second;
+}
+
+static void
+secs2rtc(uint t, struct rtcdate *r)
+{
+  uint days, y, m, n;
+
+  days = t / (24*60*60);
+  t %= 24*60*60;
+  r->hour = t / (60*60);
+  r->minute = t / 60 % 60;
+  r->second = t % 60;
+  for(y = 2000; days >= (n = isleap(y) ? 366 : 365); y++)
+    days -= n;
+  for(m = 1; days >= (n = monthdays(y, m)); m++)
+    days -= n;
+  r->year = y;
+  r->month = m;
+  r->day = days + 1;
+}
+
+void
+timerinit(void)
+{
+  struct rtcdate r;
+
+  initlock(&tq.lock, "timer");
+  cmostime(&r);
+  bootticks = ticks;
+  bootsecs = rtc2secs(&r);
+}
+
+// Current time in seconds since 2000-01-01 00:00:00 UTC.
+uint
+wallclock(void)
+{
+  return bootsecs + (ticks - bootticks) / HZ;
+}
+
+// Current date and time, in the format cmostime() returns.
+void
+walltime(struct rtcdate *r)
+{
+  secs2rtc(wallclock(), r);
+}
+
+// Absolute tick at which the local clock (TIMEZONE) next reads
+// hour:min, or the current tick if it already does.
+uint
+localtick(int hour, int min)
+{
+  uint now;
+  int cur, dmin;
+
+  now = wallclock() + TIMEZONE*60*60;
+  cur = now / 60 % (24*60);
+  dmin = ((hour*60 + min) % (24*60) - cur + 24*60) % (24*60);
+  if(dmin == 0)
+    return ticks;
+  return ticks + (dmin*60 - now % 60) * HZ;
+}
+
+// Absolute tick at which the local clock reads hour:min
+// today, or the current tick if that is already past.
+uint
+localtoday(int hour, int min)
+{
+  uint now;
+  int cur, dmin;
+
+  now = wallclock() + TIMEZONE*60*60;
+  cur = now / 60 % (24*60);
+  dmin = hour*60 + min - cur;
+  if(dmin <= 0)
+    return ticks;
+  return ticks + (dmin*60 - now % 60) * HZ;
+}
+
+//PAGEBREAK: 30
+// Timer heap.  tq.lock must be held.
+
+static int
+before(struct timer *a, struct timer *b)
+{
+  return (int)(a->when - b->when) < 0;
+}
+
+static void
+heapput(int i, struct timer *t)
+{
+  tq.heap[i] = t;
+  t->idx = i;
+}
+
+static void
+siftup(int i)
+{
+  struct timer *t;
+
+  t = tq.heap[i];
+  while(i > 0 && before(t, tq.heap[(i-1)/2])){
+    heapput(i, tq.heap[(i-1)/2]);
+    i = (i-1)/2;
+  }
+  heapput(i, t);
+}
+
+static void
+siftdown(int i)
+{
+  struct timer *t;
+  int c;
+
+  t = tq.heap[i];
+  while((c = 2*i+1) < tq.n){
+    if(c+1 < tq.n && before(tq.heap[c+1], tq.heap[c]))
+      c++;
+    if(!before(tq.heap[c], t))
+      break;
+    heapput(i, tq.heap[c]);
+    i = c;
+  }
+  heapput(i, t);
+}
+
+static void
+heapdel(struct timer *t)
+{
+  int i;
+
+  i = t->idx;
+  t->idx = -1;
+  if(--tq.n == i)
+    return;
+  heapput(i, tq.heap[tq.n]);
+  siftdown(i);
+  siftup(i);
+}
+
+// Arm t to fire at tick when, replacing any earlier setting.
+void
+timerset(struct timer *t, uint when)
+{
+  acquire(&tq.lock);
+  if(t->idx >= 0)
+    heapdel(t);
+  if(tq.n >= NTIMER)
+    panic("timerset");
+  t->when = when;
+  t->gen++;
+  heapput(tq.n++, t);
+  siftup(t->idx);
+  release(&tq.lock);
+}
+
+// Cancel t if it is armed.
+void
+timerdel(struct timer *t)
+{
+  acquire(&tq.lock);
+  if(t->idx >= 0)
+    heapdel(t);
+  t->gen++;
+  release(&tq.lock);
+}
+
+// Run the handlers of all expired timers.
+// Called on every clock tick by cpu 0.
+void
+timerfire(void)
+{
+  struct timer *t;
+  uint gen;
+
+  for(;;){
+    acquire(&tq.lock);
+    if(tq.n == 0 || (int)(tq.heap[0]->when - ticks) > 0){
+      release(&tq.lock);
+      return;
+    }
+    t = tq.heap[0];
+    heapdel(t);
+    gen = t->gen;
+    release(&tq.lock);
+    t->fn(t, gen);
+  }
+}
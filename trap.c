@@ -3,10 +3,11 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
@@ -53,7 +54,12 @@ trap(struct trapframe *tf)
       ticks++;
       wakeup(&ticks);
       release(&tickslock);
+      timerfire();
     }
+    schedtick((tf->cs & 3) == DPL_USER);
+    // Acknowledge first: the prefault below may sleep reading
+    // the stack page in, and must not hold off later interrupts.
+    lapiceoi();
     /* add for alarm function*/
     if(myproc() && (tf->cs & 3) == 3)
     {
@@ -61,13 +67,18 @@ trap(struct trapframe *tf)
 	if(myproc()->alarmticks == myproc()->curalarmticks)	//arrived cycle
 	{
 	    myproc()->curalarmticks = 0;
-	    tf->esp -= 4;
-	    *((uint *)(tf->esp)) = tf->eip;
-	    tf->eip = (uint)myproc()->alarmhandler;
+	    // The stack page may be copy-on-write or not there yet.
+	    if(uvmlimit(myproc(), tf->esp - 4) < tf->esp ||
+	       uvmprefault(myproc(), tf->esp - 4, 4, 1) < 0){
+	      myproc()->killed = 1;
+	    } else {
+	      tf->esp -= 4;
+	      *((uint *)(tf->esp)) = tf->eip;
+	      tf->eip = (uint)myproc()->alarmhandler;
+	    }
 	}
     }
     /*end here*/
-    lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
     ideintr();
@@ -91,6 +102,13 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // The kernel also faults here, writing to a copy-on-write
+    // user page on a process's behalf.
+    if(pagefault(rcr2(), tf->err) == 0)
+      break;
+    // fall through
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
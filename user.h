@@ -1,5 +1,9 @@
 struct stat;
 struct rtcdate;
+struct schedattr;
+struct rusage;
+struct procinfo;
+struct exitinfo;
 
 // system calls
 int fork(void);
@@ -32,6 +36,16 @@ int alarm(int ticks, void(*hander)());
 int setTime(int pid, int priority, int startHour, int startMin, int endHour, int endMin, int deadlineHour, int deadlineMin);
 int checkTime(int hour, int min);
 int checkPr(void);
+int setEdf(int pid, int budget, int period);
+int setSched(int pid, struct schedattr*);
+int getSched(int pid, struct schedattr*);
+int getrusage(int pid, struct rusage*);
+int wait2(struct rusage*);
+int procinfo(struct procinfo*, int);
+int exitinfo(struct exitinfo*, int);
+char* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int shmopen(int, int);
 
 // ulib.c
 int stat(char*, struct stat*);
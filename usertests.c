@@ -7,6 +7,8 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "rusage.h"
+#include "mman.h"
 
 char buf[8192];
 char name[3];
@@ -424,6 +426,263 @@ exitwait(void)
   printf(1, "exitwait ok\n");
 }
 
+// does wait2 report the cpu time a child spent spinning?
+void
+rusagetest(void)
+{
+  struct rusage ru;
+  int pid, t0;
+
+  printf(1, "rusage test\n");
+  if(getrusage(0, &ru) < 0){
+    printf(1, "getrusage failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    t0 = uptime();
+    while(uptime() < t0 + 3)
+      ;
+    exit();
+  }
+  if(wait2(&ru) != pid){
+    printf(1, "wait2 wrong pid\n");
+    exit();
+  }
+  if(ru.utime + ru.stime == 0){
+    printf(1, "rusage: child used no cpu\n");
+    exit();
+  }
+  printf(1, "rusage ok\n");
+}
+
+// do parent and child see their own writes, and only their
+// own, to pages they share copy-on-write after fork?
+void
+cowtest(void)
+{
+  int pid, i, fds[2];
+  char c;
+
+  printf(1, "cow test\n");
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i;
+  if(pipe(fds) < 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    // the kernel writes into a shared page first
+    if(read(fds[0], &buf[100], 1) != 1 || buf[100] != 'x'){
+      printf(1, "cow: child read wrong\n");
+      exit();
+    }
+    for(i = 0; i < sizeof(buf); i++)
+      if(i != 100)
+        buf[i] = ~i;
+    for(i = 0; i < sizeof(buf); i++){
+      if(i != 100 && buf[i] != (char)~i){
+        printf(1, "cow: child sees wrong data\n");
+        exit();
+      }
+    }
+    exit();
+  }
+  c = 'x';
+  write(fds[1], &c, 1);
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+  for(i = 0; i < sizeof(buf); i++){
+    if(buf[i] != (char)i){
+      printf(1, "cow: parent sees child's writes\n");
+      exit();
+    }
+  }
+  printf(1, "cow ok\n");
+}
+
+// file-backed and anonymous mmap, private and shared
+void
+mmaptest(void)
+{
+  int fd, i, pid, n;
+  char *p;
+
+  printf(1, "mmap test\n");
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "mmap: create failed\n");
+    exit();
+  }
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 26;
+  if(write(fd, buf, sizeof(buf)) != sizeof(buf) || write(fd, buf, 100) != 100){
+    printf(1, "mmap: write failed\n");
+    exit();
+  }
+  n = sizeof(buf) + 100;
+
+  // private: the file's bytes, zeros after, and writes stay here
+  p = mmap(0, n, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1){
+    printf(1, "mmap: private map failed\n");
+    exit();
+  }
+  for(i = 0; i < n; i++){
+    if(p[i] != 'a' + i % sizeof(buf) % 26){
+      printf(1, "mmap: wrong data at %d\n", i);
+      exit();
+    }
+  }
+  if(p[n] != 0){
+    printf(1, "mmap: no zeros past end of file\n");
+    exit();
+  }
+  p[0] = 'Z';
+  if(munmap(p, n) < 0){
+    printf(1, "mmap: munmap failed\n");
+    exit();
+  }
+
+  // shared: writes reach the file
+  p = mmap(0, n, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1){
+    printf(1, "mmap: shared map failed\n");
+    exit();
+  }
+  if(p[0] != 'a'){
+    printf(1, "mmap: private write reached the file\n");
+    exit();
+  }
+  p[1] = 'Y';
+  munmap(p, n);
+  close(fd);
+  fd = open("mmapfile", O_RDONLY);
+  if(read(fd, buf, 2) != 2 || buf[1] != 'Y'){
+    printf(1, "mmap: shared write did not reach the file\n");
+    exit();
+  }
+  close(fd);
+  unlink("mmapfile");
+
+  // anonymous shared memory is shared with children
+  p = mmap(0, 2*4096, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANON, -1, 0);
+  if(p == (char*)-1){
+    printf(1, "mmap: anonymous map failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    p[4096] = 'C';
+    exit();
+  }
+  wait();
+  if(p[4096] != 'C'){
+    printf(1, "mmap: child's write not shared\n");
+    exit();
+  }
+  munmap(p, 2*4096);
+  printf(1, "mmap ok\n");
+}
+
+// shared memory segments are found by key, outlive the
+// descriptor while mapped, and go away with the last mapping
+void
+shmtest(void)
+{
+  int fd, pid;
+  char *p, *q;
+
+  printf(1, "shm test\n");
+  fd = shmopen(4321, 2*4096);
+  if(fd < 0){
+    printf(1, "shm: shmopen failed\n");
+    exit();
+  }
+  p = mmap(0, 2*4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1){
+    printf(1, "shm: mmap failed\n");
+    exit();
+  }
+  close(fd);
+  if(shmopen(4321, 3*4096) >= 0){
+    printf(1, "shm: opened with a bigger size\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    // map it again by key, not through the inherited mapping
+    fd = shmopen(4321, 4096);
+    q = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 4096);
+    if(fd < 0 || q == (char*)-1){
+      printf(1, "shm: child could not map\n");
+      exit();
+    }
+    q[10] = 'S';
+    exit();
+  }
+  wait();
+  if(p[4096+10] != 'S'){
+    printf(1, "shm: child's write not seen\n");
+    exit();
+  }
+  munmap(p, 2*4096);
+
+  fd = shmopen(4321, 2*4096);
+  p = mmap(0, 2*4096, PROT_READ, MAP_SHARED, fd, 0);
+  if(fd < 0 || p == (char*)-1 || p[4096+10] != 0){
+    printf(1, "shm: segment outlived its last mapping\n");
+    exit();
+  }
+  munmap(p, 2*4096);
+  close(fd);
+  printf(1, "shm ok\n");
+}
+
+// a running program's file must not change under it,
+// since its pages are read in as they are touched.
+void
+textbusy(void)
+{
+  int fd;
+  char c;
+
+  printf(1, "text busy test\n");
+  fd = open("usertests", O_RDWR);
+  if(fd < 0){
+    printf(1, "textbusy: open failed\n");
+    exit();
+  }
+  if(read(fd, &c, 1) != 1){
+    printf(1, "textbusy: read failed\n");
+    exit();
+  }
+  if(write(fd, &c, 1) >= 0){
+    printf(1, "textbusy: wrote to a running program\n");
+    exit();
+  }
+  close(fd);
+  printf(1, "text busy ok\n");
+}
+
 void
 mem(void)
 {
@@ -1783,6 +2042,11 @@ main(int argc, char *argv[])
   pipe1();
   preempt();
   exitwait();
+  rusagetest();
+  cowtest();
+  mmaptest();
+  shmtest();
+  textbusy();
 
   rmdot();
   fourteen();
@@ -4,8 +4,15 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "elf.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "mman.h"
+#include "shm.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -39,13 +46,14 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    return 0;  // a kernel superpage; it has no PTEs
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
+    // kzalloc makes sure all those PTE_P bits are zero.
+    if(!alloc || (pgtab = (pte_t*)kzalloc()) == 0)
       return 0;
-    // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -79,13 +87,42 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
   return 0;
 }
 
+// Like mappages, for the kernel's mappings: each aligned 4 MB
+// of [va, va+size) is mapped by a single superpage directory
+// entry (PTE_PS), and only the ends that are not use page
+// tables.  Saves page table pages and TLB entries.  va and
+// size must be page-aligned; va+size may wrap to 0.
+static int
+mapkernel(pde_t *pgdir, void *va, uint size, uint pa, int perm)
+{
+  uint a, n;
+
+  for(a = (uint)va; size > 0; a += n, pa += n, size -= n){
+    if(a % SPGSIZE == 0 && pa % SPGSIZE == 0 && size >= SPGSIZE){
+      if(pgdir[PDX(a)] & PTE_P)
+        panic("remap");
+      pgdir[PDX(a)] = pa | perm | PTE_P | PTE_PS;
+      n = SPGSIZE;
+      continue;
+    }
+    n = SPGSIZE - a % SPGSIZE;
+    if(n > size)
+      n = size;
+    if(mappages(pgdir, (void*)a, n, pa, perm) < 0)
+      return -1;
+  }
+  return 0;
+}
+
 // There is one page table per process, plus one that's used when
 // a CPU is not running any process (kpgdir). The kernel uses the
 // current process's page table during system calls and interrupts;
 // page protection bits prevent user code from using the kernel's
-// mappings.
+// mappings.  The kernel half of every page directory points at
+// kpgdir's own page tables, so setupkvm() only has to allocate
+// the directory, and freevm() leaves them alone.
 //
-// setupkvm() and exec() set up every page table like this:
+// kvmalloc(), setupkvm() and exec() set up every page table like this:
 //
 //   0..KERNBASE: user memory (text+data+stack+heap), mapped to
 //                phys memory allocated by the kernel
@@ -101,7 +138,8 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 // (directly addressable from end..P2V(PHYSTOP)).
 
 // This table defines the kernel's mappings, which are present in
-// every process's page table.
+// every process's page table.  They are made once, in kpgdir,
+// and never change.
 static struct kmap {
   void *virt;
   uint phys_start;
@@ -114,33 +152,35 @@ static struct kmap {
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
-// Set up kernel part of a page table.
+// Set up kernel part of a page table, by sharing kpgdir's.
 pde_t*
 setupkvm(void)
 {
   pde_t *pgdir;
-  struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kzalloc()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
-  if (P2V(PHYSTOP) > (void*)DEVSPACE)
-    panic("PHYSTOP too high");
-  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
-      return 0;
-    }
+  memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+          (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
   return pgdir;
 }
 
 // Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// space for scheduler processes, with the kernel mappings that
+// every other page table shares.
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  struct kmap *k;
+
+  if (P2V(PHYSTOP) > (void*)DEVSPACE)
+    panic("PHYSTOP too high");
+  if((kpgdir = (pde_t*)kzalloc()) == 0)
+    panic("kvmalloc");
+  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
+    if(mapkernel(kpgdir, k->virt, k->phys_end - k->phys_start,
+                 (uint)k->phys_start, k->perm) < 0)
+      panic("kvmalloc");
   switchkvm();
 }
 
@@ -186,33 +226,104 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kzalloc();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
+// Add a region to vmas that demand-pages [start, end) from ip
+// at offset off, filesz bytes of it, and zeros after that.
+// start must be page aligned.  Takes a reference to ip.
 int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
+vmaadd(struct vma *vmas, uint start, uint end, struct inode *ip,
+       uint off, uint filesz, int perm)
 {
-  uint i, pa, n;
-  pte_t *pte;
+  struct vma *v;
+
+  if(start % PGSIZE != 0)
+    panic("vmaadd: start must be page aligned");
+  for(v = vmas; v < &vmas[NVMA]; v++){
+    if(v->flags)
+      continue;
+    v->flags = VMA_USED;
+    v->start = start;
+    v->end = PGROUNDUP(end);
+    v->ip = ip ? idup(ip) : 0;
+    v->off = off;
+    v->filesz = filesz;
+    v->perm = perm;
+    v->shm = 0;
+    return 0;
+  }
+  return -1;
+}
 
-  if((uint) addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, P2V(pa), offset+i, n) != n)
-      return -1;
+// Copy the regions of src to dst, for fork.
+void
+vmadup(struct vma *dst, struct vma *src)
+{
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    dst[i] = src[i];
+    if(dst[i].flags && dst[i].ip)
+      idup(dst[i].ip);
+    if(dst[i].flags & VMA_EXEC)
+      idenywrite(dst[i].ip);
+    if(dst[i].flags && dst[i].shm)
+      shmdup(dst[i].shm);
+  }
+}
+
+// Drop all of the regions in vmas.  Must be called inside a
+// transaction, since it may release the last reference to an inode.
+void
+vmafree(struct vma *vmas)
+{
+  struct vma *v;
+
+  for(v = vmas; v < &vmas[NVMA]; v++){
+    if(v->flags & VMA_EXEC)
+      iallowwrite(v->ip);
+    if(v->flags && v->ip)
+      iput(v->ip);
+    if(v->flags && v->shm)
+      shmclose(v->shm);
+    v->flags = 0;
   }
+}
+
+// The region of p containing va, or 0.
+struct vma*
+vmafind(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->flags && va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// Read the page of v at va into mem, which is zeroed.
+// Sleeps on the inode and the disk.
+static int
+vmaload(struct vma *v, uint va, char *mem)
+{
+  uint o, n;
+
+  o = va - v->start;
+  if(v->ip == 0 || o >= v->filesz)
+    return 0;
+  n = v->filesz - o;
+  if(n > PGSIZE)
+    n = PGSIZE;
+  ilock(v->ip);
+  if(readi(v->ip, mem, v->off + o, n) != n){
+    iunlock(v->ip);
+    return -1;
+  }
+  iunlock(v->ip);
   return 0;
 }
 
@@ -231,13 +342,12 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kzalloc();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -279,7 +389,8 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 }
 
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part.  The kernel part's page tables are
+// kpgdir's, shared by every page table, and are kept.
 void
 freevm(pde_t *pgdir)
 {
@@ -288,7 +399,7 @@ freevm(pde_t *pgdir)
   if(pgdir == 0)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
+  for(i = 0; i < PDX(KERNBASE); i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
@@ -310,38 +421,217 @@ clearpteu(pde_t *pgdir, char *uva)
   *pte &= ~PTE_U;
 }
 
-// Given a parent process's page table, create a copy
-// of it for a child.
-pde_t*
-copyuvm(pde_t *pgdir, uint sz)
+// Copy the mappings of [start, end) in pgdir to d.  Shared
+// pages stay writable in both tables; other writable pages
+// become read-only and copy-on-write in both.
+static int
+copyrange(pde_t *pgdir, pde_t *d, uint start, uint end, int shared)
 {
-  pde_t *d;
   pte_t *pte;
   uint pa, i, flags;
   char *mem;
 
-  if((d = setupkvm()) == 0)
-    return 0;
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+  for(i = start; i < end; i += PGSIZE){
+    // Skip pages that have not been faulted in yet.
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0){
+      i = PGADDR(PDX(i) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
     if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+      continue;
+    if(!(*pte & PTE_U)){
+      // Not the user's, like exec's stack guard page: the
+      // child gets its own copy rather than a copy-on-write
+      // page that only the kernel could fault on.
+      if((mem = kalloc()) == 0)
+        return -1;
+      memmove(mem, P2V(PTE_ADDR(*pte)), PGSIZE);
+      if(mappages(d, (void*)i, PGSIZE, V2P(mem), PTE_FLAGS(*pte)) < 0){
+        kfree(mem);
+        return -1;
+      }
+      continue;
+    }
+    if(!shared && (*pte & PTE_W))
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0)
-      goto bad;
+    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
+      return -1;
+    kref(P2V(pa));
   }
+  return 0;
+}
+
+// Given a parent process's page table, create a copy
+// of it for a child.  The pages themselves are shared:
+// writable ones become copy-on-write, and are copied by
+// cowfault() when either side writes, except in MAP_SHARED
+// regions.  pgdir must be the current page table.
+pde_t*
+copyuvm(pde_t *pgdir, uint sz, struct vma *vmas)
+{
+  pde_t *d;
+  struct vma *v;
+
+  if((d = setupkvm()) == 0)
+    return 0;
+  if(copyrange(pgdir, d, 0, sz, 0) < 0)
+    goto bad;
+  for(v = vmas; v < &vmas[NVMA]; v++)
+    if((v->flags & VMA_MMAP) &&
+       copyrange(pgdir, d, v->start, v->end, v->flags & VMA_SHARED) < 0)
+      goto bad;
+  lcr3(V2P(pgdir));  // flush the parent's stale writable entries
   return d;
 
 bad:
+  lcr3(V2P(pgdir));
   freevm(d);
   return 0;
 }
 
+// Resolve a write fault at user address va on a copy-on-write
+// page: copy the page, or if no one else shares it any more,
+// just make it writable again.  Returns -1 if va is not a
+// copy-on-write page or memory is short.  Does not sleep, so
+// it is safe for faults taken by the kernel with locks held.
+int
+cowfault(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  char *old, *mem;
+
+  if(va >= KERNBASE || (pte = walkpgdir(pgdir, (char*)va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_P|PTE_U|PTE_COW)) != (PTE_P|PTE_U|PTE_COW))
+    return -1;
+  old = P2V(PTE_ADDR(*pte));
+  if(krefcnt(old) == 1){
+    *pte = (*pte & ~PTE_COW) | PTE_W;
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, old, PGSIZE);
+    *pte = V2P(mem) | (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+    kfree(old);
+  }
+  invlpg((char*)PGROUNDDOWN(va));
+  return 0;
+}
+
+// Resolve a fault on a missing page at user address va below
+// p->sz.  If a region covers va, the page is read from its file;
+// otherwise it is heap that growproc() only promised, and is
+// allocated, zeroed, on first touch.  Reading a file sleeps, so
+// is refused unless cansleep is set: the kernel may fault holding
+// a spinlock, so system calls call uvmprefault first instead.
+int
+lazyfault(struct proc *p, uint va, int cansleep)
+{
+  struct vma *v;
+  char *mem;
+  int perm;
+
+  va = PGROUNDDOWN(va);
+  v = vmafind(p, va);
+  if(v == 0 && va >= p->sz)
+    return -1;
+  if(v && v->ip && !cansleep)
+    return -1;
+
+  // Whole pages of file data are shared through the page cache,
+  // unless writes must reach the file.
+  if(v && v->ip && !(v->flags & VMA_SHARED) &&
+     va - v->start + PGSIZE <= v->filesz){
+    if((mem = pcacheget(v->ip, v->off + va - v->start)) == 0)
+      return -1;
+    perm = (v->perm & PTE_W) ? PTE_COW : 0;
+    if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), perm|PTE_U) < 0){
+      kfree(mem);
+      return -1;
+    }
+    return 0;
+  }
+
+  if((mem = kzalloc()) == 0)
+    return -1;
+  perm = PTE_W;
+  if(v){
+    perm = v->perm;
+    if(vmaload(v, va, mem) < 0){
+      kfree(mem);
+      return -1;
+    }
+  }
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), perm|PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// End of the user memory that va lies in: p->sz, or the end of
+// an mmap region.  0 if va is not a user address.
+uint
+uvmlimit(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  if(va < p->sz)
+    return p->sz;
+  if((v = vmafind(p, va)) != 0)
+    return v->end;
+  return 0;
+}
+
+// Make sure the pages of [va, va+n), which must lie below
+// uvmlimit(p, va), are present and user-accessible, so the
+// kernel can use them while holding locks.  If write is set,
+// also make sure they are writable, copying copy-on-write
+// pages now, so the kernel never takes a fault it cannot
+// resolve.  Returns -1 if that is impossible or memory is short.
+int
+uvmprefault(struct proc *p, uint va, uint n, int write)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte == 0 || !(*pte & PTE_P)){
+      if(lazyfault(p, a, 1) < 0)
+        return -1;
+      pte = walkpgdir(p->pgdir, (char*)a, 0);
+    }
+    if(!(*pte & PTE_U))
+      return -1;
+    if(write && !(*pte & PTE_W)){
+      if(!(*pte & PTE_COW) || cowfault(p->pgdir, a) < 0)
+        return -1;
+    }
+  }
+  return 0;
+}
+
+// Handle a page fault by the current process at va, with
+// x86 error code err.  Returns 0 if the faulting access may
+// be retried, -1 if it is an error.
+int
+pagefault(uint va, uint err)
+{
+  struct proc *p = myproc();
+
+  if(p == 0)
+    return -1;
+  p->ru.pgfaults++;
+  if((err & FEC_PR) == 0)
+    return lazyfault(p, va, (err & FEC_U) != 0);
+  if(err & FEC_WR)
+    return cowfault(p->pgdir, va);
+  return -1;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -383,6 +673,222 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   return 0;
 }
 
+//PAGEBREAK!
+// mmap regions are placed top down from KERNBASE, below the
+// lowest existing one; the heap may grow up to that.
+
+uint
+mmapbase(struct proc *p)
+{
+  struct vma *v;
+  uint base;
+
+  base = KERNBASE;
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if((v->flags & VMA_MMAP) && v->start < base)
+      base = v->start;
+  return base;
+}
+
+// Write the dirty pages of v in [s, e) back to its file, if v
+// is a writable MAP_SHARED mapping of one.  pgdir is the page
+// table v belongs to.  Starts its own transactions, so the
+// caller must not be in one.
+static void
+vmawriteback(pde_t *pgdir, struct vma *v, uint s, uint e)
+{
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  pte_t *pte;
+  uint a, o, n, i, m;
+  char *src;
+
+  if(!(v->flags & VMA_SHARED) || v->ip == 0 || !(v->perm & PTE_W))
+    return;
+  for(a = s; a < e && (o = a - v->start) < v->filesz; a += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(pte == 0 || (*pte & (PTE_P|PTE_D)) != (PTE_P|PTE_D))
+      continue;
+    src = P2V(PTE_ADDR(*pte));
+    n = v->filesz - o;
+    if(n > PGSIZE)
+      n = PGSIZE;
+    for(i = 0; i < n; i += m){
+      m = n - i;
+      if(m > max)
+        m = max;
+      begin_op();
+      ilock(v->ip);
+      writei(v->ip, src + i, v->off + o + i, m);
+      iunlock(v->ip);
+      end_op();
+    }
+    *pte &= ~PTE_D;
+  }
+}
+
+// Write back all shared file mappings in vmas, before the
+// address space in pgdir goes away.  Not in a transaction.
+void
+vmaflush(pde_t *pgdir, struct vma *vmas)
+{
+  struct vma *v;
+
+  for(v = vmas; v < &vmas[NVMA]; v++)
+    if(v->flags & VMA_SHARED)
+      vmawriteback(pgdir, v, v->start, v->end);
+}
+
+// Map len bytes of file f from offset off, or zeros if flags
+// has MAP_ANON, into the current process; see mman.h.
+// MAP_SHARED regions are filled in at once, so that children
+// forked later share every page.  They are shared only with
+// those children, though: writes reach the file at munmap or
+// exit, and unrelated processes mapping the same file each get
+// pages of their own.  To share with those, map a shared memory
+// segment, whose own pages are mapped.  Returns the address, or -1.
+uint
+mmap(struct file *f, uint len, int prot, int flags, uint off)
+{
+  struct proc *p = myproc();
+  struct inode *ip;
+  struct shm *shm;
+  struct vma *v;
+  uint start, base, a, filesz;
+  char *pg;
+  int kind;
+
+  kind = flags & (MAP_SHARED|MAP_PRIVATE);
+  if(len == 0 || len >= KERNBASE || off % PGSIZE != 0)
+    return -1;
+  if(!(prot & PROT_READ) || (kind != MAP_SHARED && kind != MAP_PRIVATE))
+    return -1;
+  ip = 0;
+  shm = 0;
+  filesz = 0;
+  if(!(flags & MAP_ANON) && f != 0 && f->type == FD_SHM){
+    shm = f->shm;
+    if(kind != MAP_SHARED || off + len < off || off + len > shm->npages*PGSIZE)
+      return -1;
+  } else if(!(flags & MAP_ANON)){
+    if(f == 0 || f->type != FD_INODE || !f->readable)
+      return -1;
+    if(kind == MAP_SHARED && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+    ip = f->ip;
+    ilock(ip);
+    if(ip->size > off)
+      filesz = ip->size - off;
+    iunlock(ip);
+    if(filesz > len)
+      filesz = len;
+  }
+
+  len = PGROUNDUP(len);
+  base = mmapbase(p);
+  if(base < len || base - len < PGROUNDUP(p->sz))
+    return -1;
+  start = base - len;
+  if(vmaadd(p->vma, start, base, ip, off, filesz, (prot & PROT_WRITE) ? PTE_W : 0) < 0)
+    return -1;
+  v = vmafind(p, start);
+  v->flags |= VMA_MMAP;
+  if(shm){
+    shmdup(shm);
+    v->shm = shm;
+    v->flags |= VMA_SHARED;
+    for(a = start; a < base; a += PGSIZE){
+      pg = shm->page[(off + a - start) / PGSIZE];
+      if(mappages(p->pgdir, (char*)a, PGSIZE, V2P(pg), v->perm|PTE_U) < 0){
+        munmap(start, len);
+        return -1;
+      }
+      kref(pg);
+    }
+  } else if(kind == MAP_SHARED){
+    v->flags |= VMA_SHARED;
+    for(a = start; a < base; a += PGSIZE){
+      if(lazyfault(p, a, 1) < 0){
+        munmap(start, len);
+        return -1;
+      }
+    }
+  }
+  return start;
+}
+
+// Unmap the pages of mmap regions in [addr, addr+len), writing
+// back shared file mappings first.
+int
+munmap(uint addr, uint len)
+{
+  struct proc *p = myproc();
+  struct vma *v, *n;
+  uint end, s, e, d, tail;
+  int hole, free;
+
+  end = PGROUNDUP(addr + len);
+  if(addr % PGSIZE != 0 || len == 0 || end < addr || end > KERNBASE)
+    return -1;
+
+  // Punching a hole needs a free slot for the part after it;
+  // make sure of one before anything is unmapped.
+  hole = free = 0;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if((v->flags & VMA_MMAP) && v->start < addr && end < v->end)
+      hole = 1;
+    if(v->flags == 0)
+      free = 1;
+  }
+  if(hole && !free)
+    return -1;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(!(v->flags & VMA_MMAP) || v->end <= addr || v->start >= end)
+      continue;
+    s = addr > v->start ? addr : v->start;
+    e = end < v->end ? end : v->end;
+    vmawriteback(p->pgdir, v, s, e);
+    deallocuvm(p->pgdir, e, s);
+
+    if(s == v->start && e == v->end){
+      if(v->ip){
+        begin_op();
+        iput(v->ip);
+        end_op();
+      }
+      if(v->shm)
+        shmclose(v->shm);
+      v->flags = 0;
+      continue;
+    }
+    if(s > v->start && e < v->end){
+      // A hole: the part after it becomes a new region.
+      tail = v->end;
+      d = e - v->start;
+      v->end = s;
+      if(vmaadd(p->vma, e, tail, v->ip, v->off + d,
+                v->filesz > d ? v->filesz - d : 0, v->perm) < 0)
+        panic("munmap: no slot");
+      n = vmafind(p, e);
+      n->flags = v->flags;
+      if((n->shm = v->shm) != 0)
+        shmdup(n->shm);
+    }
+    if(s == v->start){
+      d = e - v->start;
+      v->off += d;
+      v->filesz = v->filesz > d ? v->filesz - d : 0;
+      v->start = e;
+    } else {
+      v->end = s;
+      if(v->filesz > s - v->start)
+        v->filesz = s - v->start;
+    }
+  }
+  lcr3(V2P(p->pgdir));
+  return 0;
+}
+
 //PAGEBREAK!
 // Blank page.
 //PAGEBREAK!
@@ -130,6 +130,27 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Atomically add v to *addr and return the old value.
+static inline uint
+xadd(volatile uint *addr, uint v)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (v), "+m" (*addr) :
+               :
+               "cc");
+  return v;
+}
+
+// Index of the least significant set bit.  v must be non-zero.
+static inline uint
+bsf(uint v)
+{
+  uint r;
+
+  asm volatile("bsfl %1,%0" : "=r" (r) : "rm" (v) : "cc");
+  return r;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -144,6 +165,13 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+// Drop the TLB entry for the page containing va.
+static inline void
+invlpg(void *va)
+{
+  asm volatile("invlpg (%0)" : : "r" (va) : "memory");
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().